@@ -0,0 +1,193 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "MidiFile.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+static uint32_t readBE(const uint8_t* p, uint8_t n)
+{
+    uint32_t val = 0;
+    for(uint8_t i = 0; i < n; ++i){
+        val = (val << 8) | p[i];
+    }
+    return val;
+}
+
+/**
+ * \brief Reads a variable length quantity.
+ *
+ * \return False if the data ended before the quantity was complete.
+ */
+static bool readVLQ(const uint8_t*& p, const uint8_t* end, uint32_t& val)
+{
+    val = 0;
+    for(uint8_t i = 0; i < 4 && p < end; ++i){
+        uint8_t byte = *p++;
+        val = (val << 7) | (byte & 0x7F);
+        if(!(byte & 0x80)){
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MidiFile::load(const std::string& path)
+{
+    events.clear();
+    std::ifstream file(path, std::ios::binary);
+    if(!file){
+        error = "Could not open " + path;
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if(data.size() < 14 || readBE(data.data(), 4) != 0x4D546864){ //MThd
+        error = "Not a standard MIDI file";
+        return false;
+    }
+    const uint32_t headerSize = readBE(&data[4], 4);
+    const uint16_t format = readBE(&data[8], 2);
+    const uint16_t nTracks = readBE(&data[10], 2);
+    const uint16_t division = readBE(&data[12], 2);
+    if(format > 1){
+        error = "Only format 0 and 1 are supported";
+        return false;
+    }
+
+    std::vector<TickEvent> tickEvents;
+    size_t pos = 8 + headerSize;
+    for(uint16_t track = 0; track < nTracks && pos + 8 <= data.size(); ++track){
+        const uint32_t chunkSize = readBE(&data[pos + 4], 4);
+        const bool isTrack = readBE(&data[pos], 4) == 0x4D54726B; //MTrk
+        pos += 8;
+        if(pos + chunkSize > data.size()){
+            error = "Truncated track chunk";
+            return false;
+        }
+        if(isTrack && !parseTrack(&data[pos], chunkSize, tickEvents)){
+            return false;
+        }
+        pos += chunkSize;
+    }
+
+    std::stable_sort(tickEvents.begin(), tickEvents.end(), [](const TickEvent& a, const TickEvent& b){
+        return a.tick < b.tick || (a.tick == b.tick && a.order < b.order);
+    });
+
+    //Apply the tempo map
+    double secondsPerTick;
+    const bool isSMPTE = division & 0x8000;
+    if(isSMPTE){
+        const int fps = -static_cast<int8_t>(division >> 8);
+        secondsPerTick = 1. / (fps * (division & 0xFF));
+    }else{
+        secondsPerTick = 500000e-6 / division; //120 bpm until the first tempo event
+    }
+    double time = 0.;
+    uint64_t lastTick = 0;
+    for(const TickEvent& ev : tickEvents){
+        time += (ev.tick - lastTick) * secondsPerTick;
+        lastTick = ev.tick;
+        if(ev.tempo){
+            if(!isSMPTE){
+                secondsPerTick = ev.tempo * 1e-6 / division;
+            }
+        }else{
+            Event event = ev.event;
+            event.time = time;
+            events.push_back(event);
+        }
+    }
+    return true;
+}
+
+bool MidiFile::parseTrack(const uint8_t* data, size_t size, std::vector<TickEvent>& out)
+{
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+    uint64_t tick = 0;
+    uint8_t runningStatus = 0;
+
+    while(p < end){
+        uint32_t delta;
+        if(!readVLQ(p, end, delta) || p >= end){
+            error = "Truncated event";
+            return false;
+        }
+        tick += delta;
+
+        uint8_t status = *p;
+        if(status & 0x80){
+            ++p;
+        }else if(runningStatus){
+            status = runningStatus;
+        }else{
+            error = "Data byte without status";
+            return false;
+        }
+
+        if(status == 0xFF){
+            //Meta event
+            if(p >= end){
+                error = "Truncated meta event";
+                return false;
+            }
+            const uint8_t type = *p++;
+            uint32_t len;
+            if(!readVLQ(p, end, len) || p + len > end){
+                error = "Truncated meta event";
+                return false;
+            }
+            if(type == 0x51 && len == 3){
+                out.push_back({tick, static_cast<uint32_t>(out.size()), readBE(p, 3), {}});
+            }else if(type == 0x2F){
+                //End of track
+                break;
+            }
+            p += len;
+            runningStatus = 0;
+        }else if(status == 0xF0 || status == 0xF7){
+            //SysEx, skipped
+            uint32_t len;
+            if(!readVLQ(p, end, len) || p + len > end){
+                error = "Truncated SysEx event";
+                return false;
+            }
+            p += len;
+            runningStatus = 0;
+        }else if(status >= 0x80 && status < 0xF0){
+            const uint8_t nData = (status & 0xF0) == 0xC0 || (status & 0xF0) == 0xD0 ? 1 : 2;
+            if(p + nData > end){
+                error = "Truncated channel message";
+                return false;
+            }
+            TickEvent ev = {tick, static_cast<uint32_t>(out.size()), 0, {0., static_cast<uint8_t>(nData + 1), {status, 0, 0}}};
+            for(uint8_t i = 0; i < nData; ++i){
+                ev.event.data[i + 1] = *p++;
+            }
+            out.push_back(ev);
+            runningStatus = status;
+        }else{
+            error = "Unexpected status byte in track";
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,79 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef MIDIFILE_H_
+#define MIDIFILE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Reader for Standard MIDI Files (format 0 and 1).
+ *
+ * All tracks are merged into one list of channel messages sorted by time.
+ * The tempo map is applied while loading, so every event carries its
+ * time in seconds. Meta events and SysEx messages are skipped.
+ */
+class MidiFile
+{
+public:
+    /**
+     * \brief A channel message with its absolute time.
+     */
+    struct Event{
+        double time; /**< Time of the event in seconds. */
+        uint8_t size; /**< Number of valid bytes in data. */
+        uint8_t data[3]; /**< Status and data bytes of the message. */
+    };
+
+    /**
+     * \brief Loads a file.
+     *
+     * \param[in] path Path of the file.
+     *
+     * \return True on success. On failure getError() contains the reason.
+     */
+    bool load(const std::string& path);
+
+    inline const std::vector<Event>& getEvents() const {return events;}
+    inline const std::string& getError() const {return error;}
+
+    /**
+     * \brief Returns the time of the last event in seconds.
+     */
+    inline double getDuration() const {return events.empty() ? 0. : events.back().time;}
+
+private:
+    std::vector<Event> events;
+    std::string error;
+
+    /**
+     * \brief An event or tempo change in ticks, before the tempo map is applied.
+     */
+    struct TickEvent{
+        uint64_t tick;
+        uint32_t order; /**< Order of reading, keeps the sort stable across tracks. */
+        uint32_t tempo; /**< Microseconds per quarter note, 0 if this is no tempo change. */
+        Event event;
+    };
+
+    bool parseTrack(const uint8_t* data, size_t size, std::vector<TickEvent>& out);
+};
+
+#endif /* MIDIFILE_H_ */
@@ -0,0 +1,102 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "WavWriter.h"
+
+static void put16(FILE* f, uint16_t val)
+{
+    uint8_t bytes[2] = {static_cast<uint8_t>(val), static_cast<uint8_t>(val >> 8)};
+    fwrite(bytes, 1, 2, f);
+}
+
+static void put32(FILE* f, uint32_t val)
+{
+    uint8_t bytes[4] = {static_cast<uint8_t>(val), static_cast<uint8_t>(val >> 8),
+                        static_cast<uint8_t>(val >> 16), static_cast<uint8_t>(val >> 24)};
+    fwrite(bytes, 1, 4, f);
+}
+
+WavWriter::~WavWriter()
+{
+    close();
+}
+
+bool WavWriter::open(const std::string& path, uint32_t rate, bool useFloat)
+{
+    close();
+    file = fopen(path.c_str(), "wb");
+    if(!file){
+        return false;
+    }
+    isFloat = useFloat;
+    sampleRate = rate;
+    nSamples = 0;
+    writeHeader();
+    return true;
+}
+
+void WavWriter::writeHeader()
+{
+    const uint16_t bytesPerSample = isFloat ? 4 : 2;
+    const uint32_t dataSize = nSamples * bytesPerSample;
+
+    fwrite("RIFF", 1, 4, file);
+    put32(file, 36 + dataSize);
+    fwrite("WAVEfmt ", 1, 8, file);
+    put32(file, 16);
+    put16(file, isFloat ? 3 : 1); //IEEE float or PCM
+    put16(file, 1); //Mono
+    put32(file, sampleRate);
+    put32(file, sampleRate * bytesPerSample);
+    put16(file, bytesPerSample);
+    put16(file, bytesPerSample * 8);
+    fwrite("data", 1, 4, file);
+    put32(file, dataSize);
+}
+
+void WavWriter::write(const float* samples, size_t n)
+{
+    if(isFloat){
+        //WAV is little endian, like every host this is built on
+        fwrite(samples, sizeof(float), n, file);
+    }else{
+        for(size_t i = 0; i < n; ++i){
+            float val = samples[i] > 1.f ? 1.f : (samples[i] < -1.f ? -1.f : samples[i]);
+            put16(file, static_cast<uint16_t>(static_cast<int16_t>(val * 32767.f)));
+        }
+    }
+    nSamples += n;
+}
+
+void WavWriter::write(const int16_t* samples, size_t n)
+{
+    for(size_t i = 0; i < n; ++i){
+        put16(file, static_cast<uint16_t>(samples[i]));
+    }
+    nSamples += n;
+}
+
+void WavWriter::close()
+{
+    if(file){
+        fseek(file, 0, SEEK_SET);
+        writeHeader();
+        fclose(file);
+        file = nullptr;
+    }
+}
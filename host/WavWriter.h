@@ -0,0 +1,73 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef WAVWRITER_H_
+#define WAVWRITER_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/**
+ * \brief Writes mono WAV files with 16 bit PCM or 32 bit float samples.
+ *
+ * The header sizes are filled in when the file is closed.
+ */
+class WavWriter
+{
+    FILE* file = nullptr;
+    bool isFloat = false;
+    uint32_t sampleRate = 0;
+    uint32_t nSamples = 0;
+
+    void writeHeader();
+
+public:
+    WavWriter() = default;
+    ~WavWriter();
+
+    /**
+     * \brief Opens the file and writes a preliminary header.
+     *
+     * \param[in] path Path of the file.
+     * \param[in] rate The sampling rate in Hz.
+     * \param[in] useFloat True for 32 bit float samples, false for 16 bit PCM.
+     *
+     * \return True on success.
+     */
+    bool open(const std::string& path, uint32_t rate, bool useFloat);
+
+    /**
+     * \brief Appends samples in [-1, 1]. Values outside are clamped for 16 bit files.
+     */
+    void write(const float* samples, size_t n);
+
+    /**
+     * \brief Appends 16 bit samples. Only valid for 16 bit files.
+     */
+    void write(const int16_t* samples, size_t n);
+
+    /**
+     * \brief Finishes the header and closes the file.
+     */
+    void close();
+
+    inline uint32_t getSampleCount() const {return nSamples;}
+};
+
+#endif /* WAVWRITER_H_ */
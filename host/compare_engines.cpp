@@ -0,0 +1,117 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*\file compare_engines.cpp
+ * \brief Compares the fixed point engine against the floating point engine.
+ *
+ * Renders a set of patches with FMOscillator and FMOscillatorQ15 and reports
+ * the peak and RMS difference of the output relative to full scale.
+ * The program fails if one of the patches exceeds the tolerance.
+ *
+ * Tolerance: RMS error below 1% of full scale for every patch.
+ * The peak error is reported but not checked, as small phase differences
+ * of the modulators get amplified by high modulation indices.
+ *
+ * Built by the host configuration in host/CMakeLists.txt.
+ */
+
+#include "FMOscillator.h"
+#include "FMOscillatorQ15.h"
+#include "oscillators.h"
+#include <cmath>
+#include <cstdio>
+
+static constexpr float RMS_TOLERANCE = 0.01f;
+static constexpr size_t N_SAMPLES = 2 * SAMPLE_RATE;
+
+struct Patch{
+    const char* name;
+    OSCParam::osc_fn carrier;
+    OSCParam::osc_fn modulator;
+    float depth; /**< Modulation depth of osc 1 onto osc 0. */
+    float feedback; /**< Modulation depth of osc 0 onto itself. */
+    float ratio; /**< Frequency ratio of osc 1. */
+};
+
+static const Patch patches[] = {
+    {"sine carrier only", &sine, &sine, 0.f, 0.f, 1.f},
+    {"sine/sine depth 0.5", &sine, &sine, .5f, 0.f, 1.f},
+    {"sine/sine depth 2", &sine, &sine, 2.f, 0.f, 2.f},
+    {"sine/triangle depth 2 (default patch)", &sine, &triangle, 2.f, 0.f, 2.f},
+    {"sine/saw depth 1", &sine, &saw, 1.f, 0.f, 3.f},
+    {"sine feedback 0.3", &sine, &sine, 0.f, .3f, 1.f},
+    {"triangle/sine depth 1", &triangle, &sine, 1.f, 0.f, .5f},
+};
+
+int main()
+{
+    bool failed = false;
+    float out[RENDER_BLOCK_SIZE];
+    float outQ15[RENDER_BLOCK_SIZE];
+    const float delta = 1000.f/SAMPLE_RATE;
+
+    printf("%-40s %10s %10s\n", "patch", "peak", "rms");
+    for(const Patch& patch : patches){
+        float modmat[N_OSC*N_OSC] = {0.f};
+        float vols[N_OSC] = {0.f};
+        float pans[N_OSC] = {0.f};
+        OSCParam params[N_OSC];
+        modmat[0*N_OSC + 1] = patch.depth;
+        modmat[0*N_OSC + 0] = patch.feedback;
+        vols[0] = 1.f;
+        params[0].oscillator = patch.carrier;
+        params[1].oscillator = patch.modulator;
+        params[1].ratio = patch.ratio;
+        for(OSCParam& param : params){
+            param.adsr.setAttack(20.f);
+            param.adsr.setDecay(300.f);
+            param.adsr.setSustain(.7f);
+            param.adsr.setRelease(100.f);
+        }
+
+        FMOscillator osc(modmat, params, vols, pans);
+        FMOscillatorQ15 oscQ15(modmat, params, vols, pans);
+        osc.init(220.f);
+        oscQ15.init(220.f);
+
+        double peak = 0.;
+        double sum = 0.;
+        for(size_t s = 0; s < N_SAMPLES; s += RENDER_BLOCK_SIZE){
+            if(s == N_SAMPLES/2){
+                osc.eventReleased();
+                oscQ15.eventReleased();
+            }
+            for(size_t i = 0; i < RENDER_BLOCK_SIZE; ++i){
+                out[i] = 0.f;
+                outQ15[i] = 0.f;
+            }
+            osc.renderBlock(out, RENDER_BLOCK_SIZE, delta);
+            oscQ15.renderBlock(outQ15, RENDER_BLOCK_SIZE, delta);
+            for(size_t i = 0; i < RENDER_BLOCK_SIZE; ++i){
+                double diff = std::fabs(out[i] - outQ15[i]);
+                peak = diff > peak ? diff : peak;
+                sum += diff * diff;
+            }
+        }
+        double rms = std::sqrt(sum / N_SAMPLES);
+        bool ok = rms < RMS_TOLERANCE;
+        failed |= !ok;
+        printf("%-40s %10.6f %10.6f %s\n", patch.name, peak, rms, ok ? "" : "FAILED");
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,177 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*\file fm_render.cpp
+ * \brief Offline renderer from Standard MIDI Files to WAV.
+ *
+ * The events of the file are parsed into a MidiEventQueue stamped with their
+ * sample position and applied by the same sample accurate block splitting as in
+ * the firmware. The synth uses the same default patch and CC mapping.
+ * Rendering runs as fast as possible, afterwards the speed relative to real time,
+ * the peak polyphony and the number of dropped notes and stolen voices are printed.
+ *
+ * Usage: fm_render [--float] [--rate Hz] [--channel n] [--tail s] [--oversample n] input.mid output.wav
+ */
+
+#include "FMSynth.h"
+#include "MidiParser.h"
+#include "MidiEventQueue.h"
+#include "SynthController.h"
+#include "MidiFile.h"
+#include "WavWriter.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+static void usage()
+{
+    fprintf(stderr,
+            "Usage: fm_render [options] input.mid output.wav\n"
+            "  --float       Write 32 bit float samples instead of 16 bit PCM. Skips the bitcrusher.\n"
+            "  --rate Hz     Sampling rate, default %d.\n"
+            "  --channel n   MIDI channel 0-15, default is omni.\n"
+            "  --tail s      Maximum time rendered after the last event, default 5.\n"
+            "  --oversample n  Render the voices at 1, 2 or 4 times the rate, default 1.\n",
+            SAMPLE_RATE);
+}
+
+int main(int argc, char** argv)
+{
+    bool useFloat = false;
+    uint32_t rate = SAMPLE_RATE;
+    uint8_t channel = 17; //Omni
+    double maxTail = 5.;
+    uint8_t oversample = 1;
+    const char* input = nullptr;
+    const char* output = nullptr;
+
+    for(int i = 1; i < argc; ++i){
+        if(!strcmp(argv[i], "--float")){
+            useFloat = true;
+        }else if(!strcmp(argv[i], "--rate") && i + 1 < argc){
+            rate = strtoul(argv[++i], nullptr, 10);
+        }else if(!strcmp(argv[i], "--channel") && i + 1 < argc){
+            channel = strtoul(argv[++i], nullptr, 10);
+        }else if(!strcmp(argv[i], "--tail") && i + 1 < argc){
+            maxTail = strtod(argv[++i], nullptr);
+        }else if(!strcmp(argv[i], "--oversample") && i + 1 < argc){
+            oversample = strtoul(argv[++i], nullptr, 10);
+        }else if(!input){
+            input = argv[i];
+        }else if(!output){
+            output = argv[i];
+        }else{
+            usage();
+            return 1;
+        }
+    }
+    if(!input || !output || rate == 0){
+        usage();
+        return 1;
+    }
+
+    MidiFile midi;
+    if(!midi.load(input)){
+        fprintf(stderr, "%s: %s\n", input, midi.getError().c_str());
+        return 1;
+    }
+
+    WavWriter wav;
+    if(!wav.open(output, rate, useFloat)){
+        fprintf(stderr, "Could not open %s\n", output);
+        return 1;
+    }
+
+    FMSynth synth;
+    synth.setSampleRate(rate);
+    SynthController control(synth);
+    control.loadDefaultPatch();
+    synth.setOversampling(oversample);
+    MidiEventQueue queue;
+    uint32_t stamp = 0;
+    queue.setClock([](void* ctx){return *static_cast<uint32_t*>(ctx);}, &stamp);
+    MidiParser<MidiEventQueue> parser(queue);
+    parser.setChannel(channel);
+
+    float block[RENDER_BLOCK_SIZE];
+    int16_t pcm[RENDER_BLOCK_SIZE];
+    uint8_t peakPolyphony = 0;
+    uint64_t pos = 0;
+
+    auto renderSamples = [&](size_t n){
+        control.renderBlock(block, n, queue, static_cast<uint32_t>(pos));
+        if(useFloat){
+            for(size_t i = 0; i < n; ++i){
+                block[i] = control.applyVolume(block[i]);
+            }
+            wav.write(block, n);
+        }else{
+            for(size_t i = 0; i < n; ++i){
+                pcm[i] = control.toPCM(block[i], 32767.f);
+            }
+            wav.write(pcm, n);
+        }
+        synth.cleanVoicePool();
+        peakPolyphony = synth.getVoicesUsed() > peakPolyphony ? synth.getVoicesUsed() : peakPolyphony;
+        pos += n;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+
+    for(const MidiFile::Event& ev : midi.getEvents()){
+        //Render the blocks before the event, the event is applied in the block holding it
+        const uint64_t target = static_cast<uint64_t>(std::llround(ev.time * rate));
+        while(pos + RENDER_BLOCK_SIZE <= target){
+            renderSamples(RENDER_BLOCK_SIZE);
+        }
+        if(queue.size() == MIDI_QUEUE_SIZE){
+            //Too many events in one block, apply the queued ones
+            renderSamples(target - pos);
+        }
+        stamp = static_cast<uint32_t>(target);
+        for(uint8_t i = 0; i < ev.size; ++i){
+            parser.consumeByte(ev.data[i]);
+        }
+    }
+    while(!queue.empty()){
+        renderSamples(RENDER_BLOCK_SIZE);
+    }
+
+    //Let the released notes ring out
+    const uint64_t tailEnd = pos + static_cast<uint64_t>(maxTail * rate);
+    while(pos < tailEnd && synth.getVoicesUsed() > 0){
+        renderSamples(RENDER_BLOCK_SIZE);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    wav.close();
+
+    const double rendered = static_cast<double>(pos) / rate;
+    const double wall = std::chrono::duration<double>(end - start).count();
+    printf("rendered:       %.3f s (%llu samples at %u Hz)\n", rendered, static_cast<unsigned long long>(pos), rate);
+    printf("wall time:      %.3f s\n", wall);
+    printf("speed:          %.1fx real time\n", wall > 0. ? rendered / wall : 0.);
+    printf("events:         %zu\n", midi.getEvents().size());
+    printf("peak polyphony: %u of %u\n", peakPolyphony, MAX_POLYPHONY);
+    printf("dropped notes:  %u\n", synth.getDroppedNotes());
+    printf("stolen voices:  %u\n", synth.getStolenVoices());
+    return 0;
+}
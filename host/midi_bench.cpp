@@ -0,0 +1,148 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*\file midi_bench.cpp
+ * \brief Throughput of the MIDI parser on recorded streams.
+ *
+ * The events of the given Standard MIDI Files are turned back into a byte
+ * stream the way a keyboard sends it: running status is used and a timing
+ * clock byte (0xF8) is interleaved every 64 bytes. Without files a dense
+ * synthetic stream is used. The stream is parsed byte by byte and in bulk,
+ * with an inlined sink and with FunctionSink, and the throughput is
+ * printed in MB/s.
+ *
+ * Usage: midi_bench [input.mid ...]
+ */
+
+#include "MidiParser.h"
+#include "MidiFile.h"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+/**
+ * \brief Sink counting the parsed events, the handlers are inlined into the parser.
+ */
+struct CountingSink{
+    uint32_t events = 0;
+    inline void noteOn(uint8_t, uint8_t) {++events;}
+    inline void noteOff(uint8_t, uint8_t) {++events;}
+    inline void controlChange(uint8_t, uint8_t) {++events;}
+    inline void controlChange14Bit(uint8_t, uint16_t) {++events;}
+    inline void pitchBend(uint16_t) {++events;}
+};
+
+static void appendEvents(const MidiFile& midi, std::vector<uint8_t>& stream)
+{
+    uint8_t running = 0;
+    for(const MidiFile::Event& ev : midi.getEvents()){
+        for(uint8_t i = 0; i < ev.size; ++i){
+            if(i == 0 && ev.data[0] == running){
+                continue;
+            }
+            if(i == 0){
+                running = ev.data[0];
+            }
+            stream.push_back(ev.data[i]);
+            if(stream.size() % 64 == 0){
+                stream.push_back(0xF8);
+            }
+        }
+    }
+}
+
+static void appendSynthetic(std::vector<uint8_t>& stream)
+{
+    static const uint8_t pattern[] = {
+        0x90, 60, 100, 64, 100, 67, 100,
+        0xB0, 11, 40, 11, 41, 11, 42,
+        0xE0, 0, 64, 10, 64,
+        0xF8,
+        0x80, 60, 0, 64, 0, 67, 0,
+    };
+    for(uint32_t i = 0; i < 1u << 16; ++i){
+        stream.insert(stream.end(), pattern, pattern + sizeof(pattern));
+    }
+}
+
+/**
+ * \brief Parses the stream until at least 64 MB went through and returns the MB/s.
+ */
+template<typename Fn>
+static double throughput(const std::vector<uint8_t>& stream, Fn parse)
+{
+    const size_t total = 64u << 20;
+    double best = 0.;
+    for(int rep = 0; rep < 3; ++rep){
+        size_t done = 0;
+        const auto start = std::chrono::steady_clock::now();
+        while(done < total){
+            parse(stream.data(), stream.size());
+            done += stream.size();
+        }
+        const auto end = std::chrono::steady_clock::now();
+        const double mbs = done / 1e6 / std::chrono::duration<double>(end - start).count();
+        best = mbs > best ? mbs : best;
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<uint8_t> stream;
+    for(int i = 1; i < argc; ++i){
+        MidiFile midi;
+        if(!midi.load(argv[i])){
+            fprintf(stderr, "%s: %s\n", argv[i], midi.getError().c_str());
+            return 1;
+        }
+        appendEvents(midi, stream);
+    }
+    if(stream.empty()){
+        appendSynthetic(stream);
+    }
+
+    CountingSink counter;
+    MidiParser<CountingSink> inlineParser(counter);
+    inlineParser.setChannel(17); //Omni
+
+    uint32_t events = 0;
+    FunctionSink functions;
+    functions.attachNoteOn([&events](uint8_t, uint8_t){++events;});
+    functions.attachNoteOff([&events](uint8_t, uint8_t){++events;});
+    functions.attachCCEvent7Bit([&events](uint8_t, uint8_t){++events;});
+    functions.attachPitchBendEvent([&events](uint16_t){++events;});
+    MidiParser<FunctionSink> functionParser(functions);
+    functionParser.setChannel(17);
+
+    printf("stream: %zu bytes\n", stream.size());
+    printf("%-24s %10s\n", "parser", "MB/s");
+    printf("%-24s %10.1f\n", "inline, byte by byte", throughput(stream, [&inlineParser](const uint8_t* data, size_t n){
+        for(size_t i = 0; i < n; ++i){
+            inlineParser.consumeByte(data[i]);
+        }
+    }));
+    printf("%-24s %10.1f\n", "inline, bulk", throughput(stream, [&inlineParser](const uint8_t* data, size_t n){
+        inlineParser.consumeByte(data, n);
+    }));
+    printf("%-24s %10.1f\n", "function, bulk", throughput(stream, [&functionParser](const uint8_t* data, size_t n){
+        functionParser.consumeByte(data, n);
+    }));
+    printf("events: %u %u\n", counter.events, events);
+    return 0;
+}
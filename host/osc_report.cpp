@@ -0,0 +1,194 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*\file osc_report.cpp
+ * \brief Accuracy and speed report for the oscillators.
+ *
+ * Compares the Bhaskara sine() and the wavetable oscillators against
+ * std::sin. Prints the peak and RMS error, the table size in flash and
+ * the time per call on the host without the loop and call overhead.
+ *
+ * Then compares the aliasing of the naive saw and square oscillators with
+ * their band limited (PolyBLEP) versions: a tone is rendered at SAMPLE_RATE and
+ * the power outside the harmonic bins of its spectrum is printed relative to the
+ * total power.
+ *
+ * Built by the host configuration in host/CMakeLists.txt.
+ */
+
+#include "oscillators.h"
+#include "wavetables.h"
+#include "OSCParam.h"
+#include "fm_defines.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+struct Candidate{
+    const char* name;
+    OSCParam::osc_fn fn;
+    size_t tableBytes;
+};
+
+static const Candidate candidates[] = {
+    {"sine (Bhaskara)", &sine, 0},
+    {"sine256", &sine256, sizeof(sineTable<256>)},
+    {"sine1024", &sine1024, sizeof(sineTable<1024>)},
+    {"sine4096", &sine4096, sizeof(sineTable<4096>)},
+};
+
+struct AliasCandidate{
+    const char* name;
+    OSCParam::osc_fn fn;
+};
+
+static const AliasCandidate aliasCandidates[] = {
+    {"saw", &saw},
+    {"saw_blep", &saw_blep},
+    {"square", &square},
+    {"square_blep", &square_blep},
+    {"square25pwm", &square25pwm},
+    {"square25pwm_blep", &square25pwm_blep},
+    {"square10pwm", &square10pwm},
+    {"square10pwm_blep", &square10pwm_blep},
+};
+
+/**
+ * \brief Power outside the harmonic bins relative to the total power in dB.
+ *
+ * The tone has exactly `cycles` periods in the n samples, so the harmonics and the
+ * aliases fall onto exact DFT bins. cycles and n must be coprime, then the aliases
+ * do not land on harmonic bins.
+ */
+static double aliasingDb(OSCParam::osc_fn fn, size_t n, size_t cycles)
+{
+    std::vector<double> signal(n);
+    const float dt = static_cast<float>(cycles) / n;
+    for(size_t i = 0; i < n; ++i){
+        const double phase = static_cast<double>(i * cycles % n) / n;
+        signal[i] = fn(static_cast<float>(phase), dt);
+    }
+    std::vector<double> cosTable(n);
+    std::vector<double> sinTable(n);
+    for(size_t i = 0; i < n; ++i){
+        cosTable[i] = std::cos(2 * M_PI * i / n);
+        sinTable[i] = std::sin(2 * M_PI * i / n);
+    }
+    double total = 0.;
+    double alias = 0.;
+    for(size_t k = 1; k < n / 2; ++k){
+        double re = 0.;
+        double im = 0.;
+        for(size_t i = 0; i < n; ++i){
+            const size_t idx = i * k % n;
+            re += signal[i] * cosTable[idx];
+            im -= signal[i] * sinTable[idx];
+        }
+        const double power = re * re + im * im;
+        total += power;
+        if(k % cycles != 0){
+            alias += power;
+        }
+    }
+    return 10. * std::log10(alias / total);
+}
+
+static constexpr size_t N_PHASES = 4096; /**< Precomputed phases for the timing, a power of two. */
+
+/**
+ * \brief Measures the time per call of an oscillator in ns.
+ *
+ * The phases are precomputed and the calls go to four independent accumulators,
+ * so the loop measures the throughput of the oscillator and does not wait for a
+ * phase update. The fastest of five runs is returned.
+ */
+static double timeCalls(OSCParam::osc_fn fn, const float* phases)
+{
+    constexpr size_t N_CALLS = 1 << 24;
+    //Call through the function pointer like the voices do
+    volatile OSCParam::osc_fn vfn = fn;
+    const OSCParam::osc_fn call = vfn;
+    double best = 1e30;
+    for(int rep = 0; rep < 5; ++rep){
+        float acc[4] = {0.f, 0.f, 0.f, 0.f};
+        auto start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < N_CALLS; i += 4){
+            const float* ph = phases + (i & (N_PHASES - 1));
+            acc[0] += call(ph[0], 0.f);
+            acc[1] += call(ph[1], 0.f);
+            acc[2] += call(ph[2], 0.f);
+            acc[3] += call(ph[3], 0.f);
+        }
+        auto end = std::chrono::steady_clock::now();
+        volatile float sink = acc[0] + acc[1] + acc[2] + acc[3];
+        (void)sink;
+        const double ns = std::chrono::duration<double, std::nano>(end - start).count() / N_CALLS;
+        best = ns < best ? ns : best;
+    }
+    return best;
+}
+
+int main()
+{
+    constexpr size_t N_POINTS = 1 << 20;
+
+    static float phases[N_PHASES];
+    float phase = 0.f;
+    for(float& ph : phases){
+        ph = phase;
+        phase += 0.0123f;
+        phase -= static_cast<int32_t>(phase);
+    }
+    //Loop and call overhead, subtracted from the results
+    const double overhead = timeCalls(&empty_osc_fn, phases);
+
+    printf("ns/call without the loop and call overhead of %.2f ns\n", overhead);
+    printf("%-18s %12s %12s %8s %10s\n", "oscillator", "peak error", "rms error", "bytes", "ns/call");
+    for(const Candidate& c : candidates){
+        double peak = 0.;
+        double sum = 0.;
+        for(size_t i = 0; i < N_POINTS; ++i){
+            const double phase = static_cast<double>(i) / N_POINTS;
+            const double err = std::fabs(c.fn(static_cast<float>(phase), 0.f) - std::sin(2 * M_PI * phase));
+            peak = err > peak ? err : peak;
+            sum += err * err;
+        }
+
+        const double ns = timeCalls(c.fn, phases) - overhead;
+
+        printf("%-18s %12.3g %12.3g %8zu %10.2f\n", c.name, peak, std::sqrt(sum / N_POINTS), c.tableBytes, ns);
+    }
+
+    //Tones of about 250 Hz, 1 kHz and 3 kHz
+    constexpr size_t N_DFT = 2048;
+    static const size_t toneCycles[] = {25, 101, 307};
+    printf("\n%-18s", "aliasing [dB]");
+    for(size_t cycles : toneCycles){
+        printf(" %8.0f Hz", static_cast<double>(cycles) * SAMPLE_RATE / N_DFT);
+    }
+    printf("\n");
+    for(const AliasCandidate& c : aliasCandidates){
+        printf("%-18s", c.name);
+        for(size_t cycles : toneCycles){
+            printf(" %11.1f", aliasingDb(c.fn, N_DFT, cycles));
+        }
+        printf("\n");
+    }
+    return 0;
+}
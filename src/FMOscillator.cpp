@@ -21,97 +21,206 @@
 #include <cmath>
 #include <cstdint>
 
-FMOscillator::FMOscillator(float* modulationMatrix, OSCParam* oscData, float* volumes, float* pans)
-    :modmat(modulationMatrix), output_volumes(volumes), data(oscData), output_pan(pans)
+/**
+ * \brief Wraps a positive phase into [0, 1).
+ */
+static inline float wrapPhase(float phase){
+    return phase - (int32_t)phase; //should be faster than modf
+}
+
+FMOscillator::FMOscillator(float* modulationMatrix, OSCParam* oscData, float* volumes, float* pans,
+                           const uint8_t* algo, const ModSchedule* sched)
+    :FMVoiceState(modulationMatrix, oscData, volumes, pans, algo, sched)
 {
-    data = oscData;
     reset();
 }
 
 void FMOscillator::reset(){
-        elapsed = 0.f;
-        frequency = 0.f;
-        releasepoint = 1e8;
-        detune = 0.f;
-        precalcDetuneFac = 1.f;
-
-        globalVol = 1.f;
-        globalPan = 0.f;
-        precalcVolLeft = .5f;
-        precalcVolRight = .5f;
-
+        resetState();
         for(uint8_t i = 0; i < N_OSC; ++i){
             phases[i] = 0.f;
         }
-
-        isInit = false;
 }
 
 void FMOscillator::init(float freq, float oscVol, float oscPan, float phaseOffset)
 {
-    frequency = freq;
-    globalVol = oscVol;
-    globalPan = oscPan;
-
-    //Precalculate values
-    precalcVolLeft = oscVol * .25f * (-oscPan + 1.f); //0.25 instead of .5 to account for the factor of 2 in the generateSample function
-    precalcVolRight = oscVol * .25f * (oscPan + 1.f);
-
+    initState(freq, oscVol, oscPan);
     for(uint8_t i = 0; i < N_OSC; ++i){
         phases[i] = phaseOffset;
     }
-    counter = 0;
-
-    isInit = true;
 }
 
 FMOscillator::~FMOscillator()
 {
 }
 
+inline void FMOscillator::calcShifts(const ModSchedule& sched, const float* phs, const float* dts, float* shifts) const
+{
+    const uint8_t nEdges = sched.nEdges;
+    for(uint8_t k = 0; k < nEdges; ++k){
+        const ModSchedule::Edge& e = sched.edges[k];
+        shifts[e.carrier] += modmat[e.index] * envRamps[e.modulator].get()
+                             * data[e.modulator].oscillator(wrapPhase(phs[e.modulator] + shifts[e.modulator]), dts[e.modulator]);
+        shifts[e.carrier] -= (int32_t)shifts[e.carrier]; //should be faster than modf
+        shifts[e.carrier] += (shifts[e.carrier] < 0.f); //Negative shifts wrap around to [0, 1)
+    }
+}
+
+template<typename Algo, uint8_t Carrier, uint8_t Modulator>
+inline void FMOscillator::modulate(const float* phs, const float* dts, float* shifts) const
+{
+    if constexpr(Algo::hasEdge(Carrier, Modulator)){
+        float mod = modmat[Carrier*N_OSC + Modulator] * envRamps[Modulator].get();
+        shifts[Carrier] += mod * data[Modulator].oscillator(wrapPhase(phs[Modulator] + shifts[Modulator]), dts[Modulator]);
+        shifts[Carrier] -= (int32_t)shifts[Carrier]; //should be faster than modf
+        shifts[Carrier] += (shifts[Carrier] < 0.f); //Negative shifts wrap around to [0, 1)
+    }
+}
+
+template<typename Algo, size_t... K>
+inline void FMOscillator::calcShiftsUnrolled(const float* phs, const float* dts, float* shifts, std::index_sequence<K...>) const
+{
+    //Iterate from last to first row, the fold keeps the order of the edges
+    (modulate<Algo, N_OSC - 1 - K / N_OSC, K % N_OSC>(phs, dts, shifts), ...);
+}
+
+template<typename Algo>
+inline void FMOscillator::calcShifts(const float* phs, const float* dts, float* shifts) const
+{
+    calcShiftsUnrolled<Algo>(phs, dts, shifts, std::make_index_sequence<N_OSC*N_OSC>{});
+}
+
 float FMOscillator::generateSample(bool isLeftChannel)
 {
-    float shifts[N_OSC] = {0.f};
-    float dummy = 0.f;
+    //A single frame without time increment, the phases are advanced by incrementPhase()
+    float output = 0.f;
+    renderBlock(&output, 1, 0.f, isLeftChannel);
+    return output;
+}
+
+void FMOscillator::generateFrame(float& left, float& right)
+{
+    left = 0.f;
+    right = 0.f;
+    renderBlock(&left, &right, 1, 0.f);
+}
 
-    if(counter & 16 || counter == 0){
-        //Recalculate ADSR every 16 steps -> every 8ms
-        for(uint8_t i=0; i < N_OSC; ++i){
-            adsrs[i] = data[i].adsr.calc_vol(elapsed, releasepoint);
+template<typename Algo, bool Stereo>
+inline void FMOscillator::renderFrames(float* outL, float* outR, size_t n, float increment,
+                                       const float* gainsL, const float* gainsR)
+{
+    const float time = (increment/1000);
+    const float real_freq = frequency * precalcDetuneFac;
+
+    float phs[N_OSC];
+    float phaseInc[N_OSC];
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        phs[i] = phases[i];
+        phaseInc[i] = time*(real_freq * data[i].ratio);
+    }
+    float t = elapsed;
+
+    //The free routing follows the compiled schedule
+    ModSchedule local;
+    const ModSchedule* sched = schedule;
+    uint32_t ops = Algo::operators;
+    if constexpr(Algo::isFree){
+        if(!sched){
+            local.compile(modmat, output_volumes);
+            sched = &local;
         }
-        counter = 1;
+        ops = sched->operatorMask;
     }
-    ++counter;
-
-    //Generate sample
-    for(int8_t i = N_OSC; i > 0; --i){
-        //Iterate from last to first row
-        for(int8_t j = 0; j < N_OSC; ++j){
-            float mod = modmat[(i-1)*N_OSC + j] * adsrs[j];
-            if(fabs(mod) > 1e-5f){
-                shifts[i-1] += mod * data[j].oscillator(phases[j] + shifts[j]);
-                shifts[i-1] -= (int32_t)shifts[i-1]; //should be faster than modf
-                shifts[i-1] = std::abs((shifts[i-1] < 0) - shifts[i-1]);
-                //shifts[i-1] = std::modf(shifts[i-1]+phases[i-1], &dummy);
+    //Without a time increment the control signals are advanced by incrementPhase()
+    const bool advance = increment > 0.f;
+    uint8_t ctrl = controlLeft;
+
+    for(size_t s = 0; s < n; ++s){
+        if(advance && !ctrl){
+            updateControl(increment, ops);
+            ctrl = CONTROL_PERIOD;
+        }
+
+
+        float shifts[N_OSC] = {0.f};
+        float left = 0.f;
+        float right = 0.f;
+        if constexpr(Algo::isFree){
+            calcShifts(*sched, phs, phaseInc, shifts);
+            for(uint8_t k = 0; k < sched->nCarriers; ++k){
+                const uint8_t i = sched->carriers[k];
+                float val = data[i].oscillator(wrapPhase(phs[i]+shifts[i]), phaseInc[i]) * envRamps[i].get();
+                left += gainsL[i] * val;
+                if(Stereo){
+                    right += gainsR[i] * val;
+                }
+            }
+        }else{
+            calcShifts<Algo>(phs, phaseInc, shifts);
+            for(uint8_t i=0; i < N_OSC; ++i){
+                if(!Algo::isCarrier(i)){
+                    continue;
+                }
+                float val = data[i].oscillator(wrapPhase(phs[i]+shifts[i]), phaseInc[i]) * envRamps[i].get();
+                left += gainsL[i] * val;
+                if(Stereo){
+                    right += gainsR[i] * val;
+                }
             }
         }
-    }
-    float output = 0.f;
-    float sign = (!isLeftChannel > 0)*2.f - 1.f;
+        outL[s] += left;
+        if(Stereo){
+            outR[s] += right;
+        }
 
-    for(uint8_t i=0; i < N_OSC; ++i){
-        //Account for panning
+        //Advance time, the control ramps and the phases of the used operators
+        t += increment;
+        if(advance){
+            advanceControl(ops);
+            --ctrl;
+        }
+        for(uint8_t i = 0; i < N_OSC; ++i){
+            if(ops & fmCarrier(i)){
+                phs[i] += phaseInc[i];
+                phs[i] -= (int32_t)(phs[i]);
+            }
+        }
+    }
 
-        float pan = (sign * output_pan[i] + 1.0f); //panning vol 2 times too large, but we account for that in precalcVol
-        //Calculate value
-        //float tphase = modf(phases[i] + shifts[i], &dummy);
-        output += pan * output_volumes[i] * data[i].oscillator(phases[i]+shifts[i]) * adsrs[i];
+    //Write back voice state
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        phases[i] = phs[i];
     }
+    elapsed = t;
+    controlLeft = ctrl;
+}
 
-    //Apply osc pan and volume
-    output *= (isLeftChannel) * precalcVolLeft + (!isLeftChannel) * precalcVolRight;
+void FMOscillator::renderBlock(float* out, size_t n, float increment, bool isLeftChannel)
+{
+    const float sign = (!isLeftChannel > 0)*2.f - 1.f;
+    const float chanVol = (isLeftChannel) * precalcVolLeft + (!isLeftChannel) * precalcVolRight;
 
-    return output;
+    float gains[N_OSC];
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        //panning vol 2 times too large, but we account for that in precalcVol
+        gains[i] = (sign * output_pan[i] + 1.0f) * output_volumes[i] * chanVol;
+    }
+    dispatchAlgorithm(algorithmId(), [&](auto algo){
+        renderFrames<decltype(algo), false>(out, nullptr, n, increment, gains, nullptr);
+    });
+}
+
+void FMOscillator::renderBlock(float* left, float* right, size_t n, float increment)
+{
+    float gainsL[N_OSC];
+    float gainsR[N_OSC];
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        gainsL[i] = (1.0f - output_pan[i]) * output_volumes[i] * precalcVolLeft;
+        gainsR[i] = (1.0f + output_pan[i]) * output_volumes[i] * precalcVolRight;
+    }
+    dispatchAlgorithm(algorithmId(), [&](auto algo){
+        renderFrames<decltype(algo), true>(left, right, n, increment, gainsL, gainsR);
+    });
 }
 
 void FMOscillator::incrementPhase(float increment)
@@ -127,17 +236,12 @@ void FMOscillator::incrementPhase(float increment)
             phases[i] += time*(real_freq * data[i].ratio);
             phases[i] -= (int32_t)(phases[i]);
         }
-}
-
-bool FMOscillator::isDone() const
-{
-    if(!isInit){
-        return true;
-    }
-    for(uint8_t i = 0; i < N_OSC; ++i){
-        if(output_volumes[i] > 1e-3 && !data[i].adsr.isDone(elapsed, releasepoint)){
-            return false;
+        if(increment > 0.f){
+            if(!controlLeft){
+                updateControl(increment, ~0u);
+                controlLeft = CONTROL_PERIOD;
+            }
+            advanceControl(~0u);
+            --controlLeft;
         }
-    }
-    return true;
 }
@@ -20,40 +20,64 @@
 #define FMOSCILLATOR_H_
 
 #include "fm_defines.h"
+#include "fm_algorithms.h"
+#include "ModSchedule.h"
 #include "OSCParam.h"
+#include "FMVoiceState.h"
 #include <cstdint>
+#include <cstddef>
+#include <utility>
 
-class FMOscillator
+class FMOscillator : public FMVoiceState
 {
-    float* modmat; /**< Pointer to the modulation matrix*/
-    float* output_volumes; /**< Volumes of the oscillators for the final output. */
-    OSCParam* data; /**< Pointer to the Oscillator informations.*/
-    float* output_pan; /**< Panning value for the output oscillators. 0 is center, -1 left and 1 right.*/
-
     float phases[N_OSC]; /**< Phase value for individual oscillators.*/
 
-    float frequency; /**< Frequency of the oscillator. */
-
-    float elapsed; /**< Elapsed time since sounding in ms.*/
-    float releasepoint; /**< Timepoint of when the note was released. */
-
-    float detune; /**< Oscillator detune amount in Cents. */
-    float precalcDetuneFac; /**< Precalculated detuning factor. */
-
-    float globalVol; /**< Global volume of this oscillator. */
-    float globalPan; /*< Global panning of this oscillator. */
+    /**
+     * \brief Adds the modulation of one edge to the phase shift of the carrier.
+     *
+     * Does nothing if the edge is not part of the algorithm.
+     */
+    template<typename Algo, uint8_t Carrier, uint8_t Modulator>
+    inline void modulate(const float* phs, const float* dts, float* shifts) const;
 
-    float precalcVolLeft; /**< Precalculated global volume for the left channel. */
-    float precalcVolRight; /**< Precalculated global volume for the right channel. */;
+    /**
+     * \brief Evaluates the edges in the order given by K.
+     */
+    template<typename Algo, size_t... K>
+    inline void calcShiftsUnrolled(const float* phs, const float* dts, float* shifts, std::index_sequence<K...>) const;
 
-    bool isInit = false; /**< Is the oscillator considered initialized or not. */;
+    /**
+     * \brief Calculates the phase shifts of all oscillators for one sample.
+     *
+     * The operator graph of the algorithm is fully unrolled at compile time.
+     *
+     * \param[in] phs The current phases of the oscillators.
+     * \param[in] dts The phase increments per sample, used by the band limited oscillators.
+     * \param[out] shifts The resulting phase shifts. Must be zeroed beforehand.
+     */
+    template<typename Algo>
+    inline void calcShifts(const float* phs, const float* dts, float* shifts) const;
 
-    float adsrs[N_OSC] = {0}; /**< Calculated ADSR values. */
-    uint8_t counter = 0; /**< Counter used to update the adsr values every 16th sample. */
+    /**
+     * \brief Calculates the phase shifts following a compiled schedule.
+     *
+     * Used by the free routing, only the non zero edges are evaluated.
+     */
+    inline void calcShifts(const ModSchedule& sched, const float* phs, const float* dts, float* shifts) const;
 
+    /**
+     * \brief Renders n frames with precalculated per oscillator gains.
+     *
+     * The modulation chain is evaluated once per frame. If Stereo is true
+     * the carrier outputs are written to both channels, else only outL is used.
+     */
+    template<typename Algo, bool Stereo>
+    inline void renderFrames(float* outL, float* outR, size_t n, float increment,
+                             const float* gainsL, const float* gainsR);
 
 public:
-    FMOscillator(float* modulationMatrix, OSCParam* oscData, float* volumes, float* pans);
+    FMOscillator(float* modulationMatrix, OSCParam* oscData, float* volumes, float* pans,
+                 const uint8_t* algo=nullptr, const ModSchedule* sched=nullptr);
     ~FMOscillator();
 
     /** \brief Sets all relevant values to default.
@@ -83,63 +107,50 @@ public:
      */
     float generateSample(bool isLeftChannel=true);
 
-    /**
-     * \brief Increments the phases.
+    /** \brief Generates a stereo frame.
      *
-     * \param[in] increment The time increment in ms.
-     */
-    void incrementPhase(float increment);
-
-    /**
-     * \brief Checks if the oscillator produces any sound.
+     * The modulation chain and the carriers are evaluated once and
+     * the panning is applied for both channels. This is half as
+     * expensive as calling generateSample() for each channel.
+     *
+     * \param[out] left The sample for the left channel.
+     * \param[out] right The sample for the right channel.
      */
-    bool isDone() const;
+    void generateFrame(float& left, float& right);
 
-    /**
-     * \brief Sets the detuning amount of the oscillator.
+    /** \brief Renders a block of samples.
+     *
+     * Equivalent to calling generateSample() followed by incrementPhase() n times,
+     * but the per sample bookkeeping (phase increments, panning, volumes) is
+     * only done once per block and the voice state is kept in local variables.
+     *
+     * The generated samples are added onto the existing content of the buffer.
      *
-     * \param[in] cents The detuning amount in cents.
+     * \param[in,out] out The buffer the samples are added to.
+     * \param[in] n Number of samples to render.
+     * \param[in] increment The time increment per sample in ms.
+     * \param[in] isLeftChannel True if the samples are for the left channel, false if for the right channel.
      */
-    inline void setDetune(float cents) {detune = cents; precalcDetuneFac = powf(2.f, detune/1200.f);}
+    void renderBlock(float* out, size_t n, float increment, bool isLeftChannel=true);
 
-    //cents to ratio formula: 2^(c/1200)
-    //this can be easily verified by solving 440 * 2^((note*100 - 4900 + c)/1200) * b = 440 * 2^((note-49)/12)
-    //for b
-
-    /** \brief Marks the note as released to the oscillator.
+    /** \brief Renders a block of stereo frames.
      *
-     * The currently stored timepoint will be used as the release timepoint.
+     * Stereo version of renderBlock(). The modulation chain is only
+     * evaluated once per frame for both channels.
      *
-     * \note The storing of the timepoint will only take place if there is not one already set.
-     *       This is done to prevent continuous release calls which let the oscillator
-     *       play indefinitely.
-     */
-    inline void eventReleased() {
-        if(releasepoint > elapsed){
-            releasepoint = elapsed;
-        }
-        counter = 0;
-        for(uint8_t i = 0; i < N_OSC; ++i){
-            data[i].adsr.fastReleaseUpdate(adsrs[i]);
-        }
-    }
-
-    inline float getElapsedTime() const {return elapsed;}
-
-    /*
-     * \brief Sets a new elapsed time value.
-     *
-     * This can be used to enable legato playing.
+     * \param[in,out] left The buffer the left channel samples are added to.
+     * \param[in,out] right The buffer the right channel samples are added to.
+     * \param[in] n Number of frames to render.
+     * \param[in] increment The time increment per sample in ms.
      */
-    inline void overrideTimePos(float newPos) {elapsed = newPos;}
+    void renderBlock(float* left, float* right, size_t n, float increment);
 
-    /*
-     * \brief Sets a new frequency to be played.
+    /**
+     * \brief Increments the phases.
      *
-     * Updates the Oscillator to play a new frequency.
-     * This is useful for legato playing.
+     * \param[in] increment The time increment in ms.
      */
-    inline void overrideFrequency(float newFreq) {frequency = newFreq;}
+    void incrementPhase(float increment);
 };
 
 #endif /* FMOSCILLATOR_H_ */
@@ -0,0 +1,277 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "FMOscillatorQ15.h"
+#include "oscillators.h"
+#include <cmath>
+#include <cstdint>
+
+osc_fn_q15 findOscillatorQ15(OSCParam::osc_fn fn)
+{
+    if(fn == &sine){
+        return &sine_q15;
+    }else if(fn == &triangle){
+        return &triangle_q15;
+    }else if(fn == &saw){
+        return &saw_q15;
+    }else if(fn == &square){
+        return &square_q15;
+    }else if(fn == &square25pwm){
+        return &square25pwm_q15;
+    }else if(fn == &square10pwm){
+        return &square10pwm_q15;
+    }else if(fn == &empty_osc_fn || fn == &dummy_evaluator){
+        return &empty_q15;
+    }
+    return nullptr;
+}
+
+FMOscillatorQ15::FMOscillatorQ15(float* modulationMatrix, OSCParam* oscData, float* volumes, float* pans,
+                                 const uint8_t* algo, const ModSchedule* sched)
+    :FMVoiceState(modulationMatrix, oscData, volumes, pans, algo, sched)
+{
+    reset();
+}
+
+FMOscillatorQ15::~FMOscillatorQ15()
+{
+}
+
+void FMOscillatorQ15::reset(){
+        resetState();
+        for(uint8_t i = 0; i < N_OSC; ++i){
+            phases[i] = 0;
+        }
+}
+
+void FMOscillatorQ15::init(float freq, float oscVol, float oscPan, float phaseOffset)
+{
+    initState(freq, oscVol, oscPan);
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        phases[i] = float_to_phase(phaseOffset);
+    }
+}
+
+inline void FMOscillatorQ15::calcRamps(const ModSchedule& sched, const float* edgeDepths,
+                                       const float* scaledGainsL, const float* scaledGainsR, uint8_t samples)
+{
+    const float inv = samples ? 1.f/samples : 0.f;
+    for(uint8_t k = 0; k < sched.nEdges; ++k){
+        const ControlRamp& env = envRamps[sched.edges[k].modulator];
+        const float start = edgeDepths[k] * env.get();
+        depths[k] = (int32_t)start;
+        depthSteps[k] = (int32_t)((edgeDepths[k] * env.getTarget() - start) * inv);
+    }
+    for(uint8_t k = 0; k < sched.nCarriers; ++k){
+        const uint8_t i = sched.carriers[k];
+        const ControlRamp& env = envRamps[i];
+        float start = scaledGainsL[i] * env.get();
+        envGainsL[i] = (int32_t)start;
+        gainStepsL[i] = (int32_t)((scaledGainsL[i] * env.getTarget() - start) * inv);
+        if(scaledGainsR){
+            start = scaledGainsR[i] * env.get();
+            envGainsR[i] = (int32_t)start;
+            gainStepsR[i] = (int32_t)((scaledGainsR[i] * env.getTarget() - start) * inv);
+        }
+    }
+}
+
+inline void FMOscillatorQ15::calcShifts(const ModSchedule& sched, const uint32_t* phs, int32_t* shifts) const
+{
+    //The edges are ordered from the last to the first row
+    for(uint8_t k = 0; k < sched.nEdges; ++k){
+        const ModSchedule::Edge& e = sched.edges[k];
+        //Shifts are scaled by 2^26, the shift to 2^32 lets them wrap around
+        q15_t val = evalOsc(e.modulator, phs[e.modulator] + ((uint32_t)shifts[e.modulator] << 6));
+        shifts[e.carrier] = smlawb(depths[k], val, shifts[e.carrier]);
+    }
+}
+
+template<bool Stereo>
+inline void FMOscillatorQ15::renderFrames(float* outL, float* outR, size_t n, float increment,
+                                          const float* gainsL, const float* gainsR)
+{
+    const float time = (increment/1000);
+    const float real_freq = frequency * precalcDetuneFac;
+
+    uint32_t phs[N_OSC];
+    uint32_t phaseInc[N_OSC];
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        phs[i] = phases[i];
+        dts[i] = time*(real_freq * data[i].ratio);
+        phaseInc[i] = float_to_phase(dts[i]);
+        fns[i] = findOscillatorQ15(data[i].oscillator);
+    }
+    //The routing is fixed for the whole block. The schedule of the synth already masks
+    //the modulation matrix with the algorithm, standalone voices compile it per block.
+    const uint8_t algo = algorithmId();
+    ModSchedule local;
+    const ModSchedule* sched = schedule;
+    if(!sched){
+        local.compile(modmat, output_volumes, fmAlgorithmEdges(algo), fmAlgorithmCarriers(algo));
+        sched = &local;
+    }
+    float t = elapsed;
+
+    //The envelopes stay within [0, 1], so the depths can be limited once per block
+    float edgeDepths[N_OSC*N_OSC];
+    for(uint8_t k = 0; k < sched->nEdges; ++k){
+        float depth = modmat[sched->edges[k].index];
+        depth = (depth > 15.f) * 15.f + (depth < -15.f) * -15.f + (depth <= 15.f && depth >= -15.f) * depth;
+        edgeDepths[k] = depth * 134217728.f; //2^27
+    }
+    float scaledGainsL[N_OSC];
+    float scaledGainsR[N_OSC];
+    for(uint8_t k = 0; k < sched->nCarriers; ++k){
+        const uint8_t i = sched->carriers[k];
+        scaledGainsL[i] = gainsL[i] * 65536.f;
+        if(Stereo){
+            scaledGainsR[i] = gainsR[i] * 65536.f;
+        }
+    }
+    //Without a time increment the control signals are advanced by incrementPhase()
+    const bool advance = increment > 0.f;
+    uint8_t ctrl = controlLeft;
+    //The depths and gains are ramped in fixed point, the envelope ramps are caught up at the end of the block
+    uint8_t sinceCtrl = 0;
+    if(!advance || ctrl){
+        calcRamps(*sched, edgeDepths, scaledGainsL, Stereo ? scaledGainsR : nullptr, advance ? ctrl : 0);
+    }
+
+    for(size_t s = 0; s < n; ++s){
+        if(advance && !ctrl){
+            updateControl(increment, sched->operatorMask);
+            calcRamps(*sched, edgeDepths, scaledGainsL, Stereo ? scaledGainsR : nullptr, CONTROL_PERIOD);
+            ctrl = CONTROL_PERIOD;
+            sinceCtrl = 0;
+        }
+
+        int32_t shifts[N_OSC] = {0};
+        calcShifts(*sched, phs, shifts);
+
+        int32_t left = 0;
+        int32_t right = 0;
+        for(uint8_t k = 0; k < sched->nCarriers; ++k){
+            const uint8_t i = sched->carriers[k];
+            q15_t val = evalOsc(i, phs[i] + ((uint32_t)shifts[i] << 6));
+            left = qmlawb(envGainsL[i], val, left);
+            envGainsL[i] += gainStepsL[i];
+            if(Stereo){
+                right = qmlawb(envGainsR[i], val, right);
+                envGainsR[i] += gainStepsR[i];
+            }
+        }
+        outL[s] += q15_to_float(left);
+        if(Stereo){
+            outR[s] += q15_to_float(right);
+        }
+
+        //Advance time, the control ramps and the phases of the used operators, the phases wrap around on their own
+        t += increment;
+        for(uint8_t k = 0; k < sched->nEdges; ++k){
+            depths[k] += depthSteps[k];
+        }
+        if(advance){
+            ++sinceCtrl;
+            --ctrl;
+        }
+        for(uint8_t i = 0; i < N_OSC; ++i){
+            phs[i] += (sched->operatorMask & fmCarrier(i)) ? phaseInc[i] : 0;
+        }
+    }
+
+    //Write back voice state
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        phases[i] = phs[i];
+        if(sched->operatorMask & fmCarrier(i)){
+            envRamps[i].advance(sinceCtrl);
+        }
+    }
+    elapsed = t;
+    controlLeft = ctrl;
+}
+
+float FMOscillatorQ15::generateSample(bool isLeftChannel)
+{
+    float output = 0.f;
+    const float sign = (!isLeftChannel > 0)*2.f - 1.f;
+    const float chanVol = (isLeftChannel) * precalcVolLeft + (!isLeftChannel) * precalcVolRight;
+
+    float gains[N_OSC];
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        gains[i] = (sign * output_pan[i] + 1.0f) * output_volumes[i] * chanVol;
+    }
+    //A single frame without time increment, the phases are advanced by incrementPhase()
+    renderFrames<false>(&output, nullptr, 1, 0.f, gains, nullptr);
+    return output;
+}
+
+void FMOscillatorQ15::generateFrame(float& left, float& right)
+{
+    left = 0.f;
+    right = 0.f;
+    float gainsL[N_OSC];
+    float gainsR[N_OSC];
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        gainsL[i] = (1.0f - output_pan[i]) * output_volumes[i] * precalcVolLeft;
+        gainsR[i] = (1.0f + output_pan[i]) * output_volumes[i] * precalcVolRight;
+    }
+    renderFrames<true>(&left, &right, 1, 0.f, gainsL, gainsR);
+}
+
+void FMOscillatorQ15::renderBlock(float* out, size_t n, float increment, bool isLeftChannel)
+{
+    const float sign = (!isLeftChannel > 0)*2.f - 1.f;
+    const float chanVol = (isLeftChannel) * precalcVolLeft + (!isLeftChannel) * precalcVolRight;
+
+    float gains[N_OSC];
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        gains[i] = (sign * output_pan[i] + 1.0f) * output_volumes[i] * chanVol;
+    }
+    renderFrames<false>(out, nullptr, n, increment, gains, nullptr);
+}
+
+void FMOscillatorQ15::renderBlock(float* left, float* right, size_t n, float increment)
+{
+    float gainsL[N_OSC];
+    float gainsR[N_OSC];
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        gainsL[i] = (1.0f - output_pan[i]) * output_volumes[i] * precalcVolLeft;
+        gainsR[i] = (1.0f + output_pan[i]) * output_volumes[i] * precalcVolRight;
+    }
+    renderFrames<true>(left, right, n, increment, gainsL, gainsR);
+}
+
+void FMOscillatorQ15::incrementPhase(float increment)
+{
+        elapsed += increment;
+        float time = (increment/1000);
+
+        float real_freq = frequency * precalcDetuneFac;
+        for(uint8_t i = 0; i < N_OSC; ++i){
+            phases[i] += float_to_phase(time*(real_freq * data[i].ratio));
+        }
+        if(increment > 0.f){
+            if(!controlLeft){
+                updateControl(increment, ~0u);
+                controlLeft = CONTROL_PERIOD;
+            }
+            advanceControl(~0u);
+            --controlLeft;
+        }
+}
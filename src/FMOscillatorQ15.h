@@ -0,0 +1,161 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef FMOSCILLATORQ15_H_
+#define FMOSCILLATORQ15_H_
+
+#include "fm_defines.h"
+#include "fm_algorithms.h"
+#include "ModSchedule.h"
+#include "OSCParam.h"
+#include "FMVoiceState.h"
+#include "oscillators_q15.h"
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * \brief Fixed point version of FMOscillator.
+ *
+ * It has the same interface as FMOscillator and is used by FMSynth if
+ * FM_FIXED_POINT is set.
+ *
+ * The phases are 32 bit accumulators which wrap around for free, the operator
+ * outputs are Q15 and the modulation and output sums are built with SMLAWB.
+ * The envelopes are evaluated in floating point at control rate. At every control
+ * point the depths and gains including the envelopes are converted into fixed point
+ * ramps, so the samples in between only use integer arithmetic.
+ *
+ * Number formats:
+ *  - Phases: 2^32 equals one cycle.
+ *  - Phase shifts: 2^26 equals one cycle, so the sum of the modulators wraps for free as well.
+ *  - Modulation depths: 2^27 equals one cycle, limited to +-15 cycles.
+ *  - Carrier gains: 2^16 equals a gain of 1.
+ */
+class FMOscillatorQ15 : public FMVoiceState
+{
+    uint32_t phases[N_OSC]; /**< Phase accumulators for individual oscillators.*/
+
+    int32_t depths[N_OSC*N_OSC] = {0}; /**< Modulation depths of the schedule edges including the modulator envelope. */
+    int32_t depthSteps[N_OSC*N_OSC] = {0}; /**< Increment of the depths per sample. */
+    int32_t envGainsL[N_OSC] = {0}; /**< Carrier gains including the envelope, 2^16 is a gain of 1. */
+    int32_t envGainsR[N_OSC] = {0}; /**< Carrier gains for the right channel. */
+    int32_t gainStepsL[N_OSC] = {0}; /**< Increment of the left gains per sample. */
+    int32_t gainStepsR[N_OSC] = {0}; /**< Increment of the right gains per sample. */
+    osc_fn_q15 fns[N_OSC]; /**< Fixed point oscillators, nullptr if only a floating point version exists. */
+    float dts[N_OSC] = {0.f}; /**< Phase increments per sample for the floating point fallback. */
+
+    /**
+     * \brief Evaluates oscillator i at the given phase.
+     *
+     * Falls back to the floating point oscillator if there is no fixed point version.
+     * Its phase keeps the upper 24 bits, which convert exactly and stay below 1.
+     */
+    inline q15_t evalOsc(uint8_t i, uint32_t phase) const{
+        return fns[i] ? fns[i](phase) : float_to_q15(data[i].oscillator((phase >> 8) * (1.f/16777216.f), dts[i]));
+    }
+
+    /**
+     * \brief Converts the depths and gains including the envelopes into fixed point ramps.
+     *
+     * Called at the control points and at the start of a block, in between the ramps
+     * only take an integer addition per sample.
+     *
+     * \param[in] sched The schedule of the block.
+     * \param[in] edgeDepths The depths of the edges scaled by 2^27 and limited to +-15 cycles.
+     * \param[in] scaledGainsL The gains of the carriers scaled by 2^16.
+     * \param[in] scaledGainsR The gains for the right channel, nullptr for mono.
+     * \param[in] samples Samples until the next control point, 0 to hold the values.
+     */
+    inline void calcRamps(const ModSchedule& sched, const float* edgeDepths,
+                          const float* scaledGainsL, const float* scaledGainsR, uint8_t samples);
+
+    /**
+     * \brief Calculates the phase shifts of all oscillators for one sample.
+     *
+     * Only the edges of the schedule are evaluated.
+     */
+    inline void calcShifts(const ModSchedule& sched, const uint32_t* phs, int32_t* shifts) const;
+
+    template<bool Stereo>
+    inline void renderFrames(float* outL, float* outR, size_t n, float increment,
+                             const float* gainsL, const float* gainsR);
+
+public:
+    FMOscillatorQ15(float* modulationMatrix, OSCParam* oscData, float* volumes, float* pans,
+                    const uint8_t* algo=nullptr, const ModSchedule* sched=nullptr);
+    ~FMOscillatorQ15();
+
+    /** \brief Sets all relevant values to default.
+     *
+     */
+    void reset();
+
+    /**
+     * \brief Initializes everything to play a note at a certain frequency.
+     *
+     * \param[in] freq The frequency to play.
+     * \param[in] oscVol The volume of the output.
+     * \param[in] oscPan The panning of the output.
+     * \param[in] phaseOffset The starting phase offset. Must be in [0, 1].
+     *
+     * \warning Assumes that everything has been reset beforehand.
+     */
+    void init(float freq, float oscVol=1.f, float oscPan=0.f, float phaseOffset=0.f);
+
+    /** \brief Generates a Sample.
+     *
+     * \param[in] isLeftChannel True if the desired value is for the left channel, false if for the right channel.
+     *
+     * \return The generated sample.
+     */
+    float generateSample(bool isLeftChannel=true);
+
+    /** \brief Generates a stereo frame.
+     *
+     * \param[out] left The sample for the left channel.
+     * \param[out] right The sample for the right channel.
+     */
+    void generateFrame(float& left, float& right);
+
+    /** \brief Renders a block of samples and adds them onto the buffer.
+     *
+     * \param[in,out] out The buffer the samples are added to.
+     * \param[in] n Number of samples to render.
+     * \param[in] increment The time increment per sample in ms.
+     * \param[in] isLeftChannel True if the samples are for the left channel, false if for the right channel.
+     */
+    void renderBlock(float* out, size_t n, float increment, bool isLeftChannel=true);
+
+    /** \brief Renders a block of stereo frames and adds them onto the buffers.
+     *
+     * \param[in,out] left The buffer the left channel samples are added to.
+     * \param[in,out] right The buffer the right channel samples are added to.
+     * \param[in] n Number of frames to render.
+     * \param[in] increment The time increment per sample in ms.
+     */
+    void renderBlock(float* left, float* right, size_t n, float increment);
+
+    /**
+     * \brief Increments the phases.
+     *
+     * \param[in] increment The time increment in ms.
+     */
+    void incrementPhase(float increment);
+};
+
+#endif /* FMOSCILLATORQ15_H_ */
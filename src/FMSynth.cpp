@@ -25,83 +25,188 @@ FMSynth::FMSynth()
     voices.reserve(MAX_POLYPHONY);
     for(uint8_t i = 0; i < N_OSC; ++i){
         oscParams[i].adsr.precalc();
+        volParams[i].jumpTo(outputVols[i]);
+        panParams[i].jumpTo(outputPans[i]);
+    }
+    for(uint8_t i = 0; i < N_OSC*N_OSC; ++i){
+        modParams[i].jumpTo(modMatrix[i]);
     }
     for(uint8_t i = 0; i < MAX_POLYPHONY; ++i){
-        voices.push_back(Voice(modMatrix, oscParams, outputVols, outputPans));
+        voices.push_back(Voice(modMatrix, oscParams, outputVols, outputPans, &algorithm, &schedule));
     }
 
 }
 
-void FMSynth::PlayNote(KeyEvent &info, float elapsed)
+void FMSynth::updateParams(size_t n)
 {
-    float hz = calcHzFromMidi(info.note);
-
-    if(unison > 0){
-        //Create spread out voices
-        float stepsize = 1.f/(unison); //1/(1 + unison - 1) = 1/(unison)
-        uint8_t nCenter = unison & 1 ? 1 : 2; //Use 2 center voices for the volume if the number of voices is even, 1 if odd.
-        for(uint8_t i = 0; i < unison; ++i){
-            FMOscillator* voice = findFreeOscillator();
-            if(!voice){ //Should be unnecessary ;)
-                //Fatal Error, abort.
-                throw std::exception();
-            }
+    const float coef = smoothingCoef(n, sampleDelta);
+    bool routingChanged = false;
+    for(uint8_t i = 0; i < N_OSC*N_OSC; ++i){
+        const float val = modParams[i].update(coef);
+        routingChanged |= (val != 0.f) != (modMatrix[i] != 0.f);
+        modMatrix[i] = val;
+    }
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        const float vol = volParams[i].update(coef);
+        routingChanged |= (vol != 0.f) != (outputVols[i] != 0.f);
+        outputVols[i] = vol;
+        outputPans[i] = panParams[i].update(coef);
+    }
+    if(routingChanged){
+        compileSchedule();
+    }
+}
 
-            //If the Voices belong to the center use normal loudness, else use unisonVol as loudness.
-            float vel_fac = (i >= unison/2 && i < unison/2+nCenter) ? 1.f : unisonVol;
+void FMSynth::PlayNote(uint8_t note, uint8_t velocity, float elapsed)
+{
+    float hz = calcHzFromMidi(note);
+    //Without unison one voice is played, else unison voices
+    const uint8_t nVoices = unison == 0 ? 1 : (unison < MAX_POLYPHONY ? unison : MAX_POLYPHONY);
+    //The unison voices must not steal each other
+    const uint32_t noteAge = voiceAge;
+    KeyEvent* info = nullptr;
 
-            voice->init(hz, vel_fac * info.velocity/127.f, //
-                        -unisonPan + i * 2 * unisonPan * stepsize, //Set panning from -unisonPan to +unisonPan
-                        unisonPhase * i * stepsize); //Set Phase from  0 to unisonPhase.
-            voice->setDetune(-.5f * unisonPitch + i * unisonPitch * stepsize + globalDetune); //Spread detune evenly from -1/2 unisonPitch to 1/2 unisonPitch.
-            //NOTE: Currently global pitch automation and unison wont work together!
-            voice->overrideTimePos(elapsed);
-            info.voices[i] = voice;
+    //Spread out voices
+    float stepsize = 1.f/(nVoices); //1/(1 + unison - 1) = 1/(unison)
+    uint8_t nCenter = nVoices & 1 ? 1 : 2; //Use 2 center voices for the volume if the number of voices is even, 1 if odd.
+    for(uint8_t i = 0; i < nVoices; ++i){
+        Voice* voice = findFreeVoice(noteAge);
+        if(!voice){
+            //Play with the voices we got
+            droppedNotes += (i == 0);
+            return;
         }
-    }else{
-        //Only one voice to deal with
-        FMOscillator* voice = findFreeOscillator();
-        if(!voice){ //Should be unnecessary ;)
-            //Fatal Error, abort.
-            //throw std::exception();
+        if(!info){
+            //There is always a key event left once the first voice is detached from its old key
+            info = allocKeyEvent(note, velocity, nVoices);
+        }
+        attachVoice(*info, i, *voice);
+
+        if(nVoices == 1){
+            //Only one voice to deal with
+            startVoice(*voice, hz, velocity/127.f, 0.f, 0.f, globalDetune, elapsed);
             return;
         }
-        voice->init(hz, info.velocity/127.f);
-        voice->overrideTimePos(elapsed);
-        voice->setDetune(globalDetune);
-        info.voices[0] = voice;
+
+        //If the Voices belong to the center use normal loudness, else use unisonVol as loudness.
+        float vel_fac = (i >= nVoices/2 && i < nVoices/2+nCenter) ? 1.f : unisonVol;
+
+        startVoice(*voice, hz, vel_fac * velocity/127.f, //
+                   -unisonPan + i * 2 * unisonPan * stepsize, //Set panning from -unisonPan to +unisonPan
+                   unisonPhase * i * stepsize, //Set Phase from  0 to unisonPhase.
+                   -.5f * unisonPitch + i * unisonPitch * stepsize + globalDetune, //Spread detune evenly from -1/2 unisonPitch to 1/2 unisonPitch.
+                   elapsed);
+        //NOTE: Currently global pitch automation and unison wont work together!
+    }
+}
+
+void FMSynth::detachVoice(Voice& voice)
+{
+    if(voice.keyIndex == NO_KEY){
+        return;
+    }
+    KeyEvent& key = keyEvents[voice.keyIndex];
+    key.voices[voice.keySlot] = nullptr;
+    voice.keyIndex = NO_KEY;
+    if(!--key.nAttached){
+        freeKeyEvent(key);
+    }
+}
+
+void FMSynth::startVoice(Voice& voice, float hz, float vol, float pan, float phase, float detune, float elapsed)
+{
+    if(voice.fadeRemaining){
+        //The stolen note is still fading out
+        voice.pending = {hz, vol, pan, phase, detune, elapsed, false};
+        return;
     }
+    voice.osc.init(hz, vol, pan, phase);
+    voice.osc.setDetune(detune);
+    voice.osc.overrideTimePos(elapsed);
+}
+
+void FMSynth::finishSteal(Voice& voice)
+{
+    voice.fadeRemaining = 0;
+    voice.osc.reset();
+    if(voice.pending.released){
+        //The new note was already released during the fade
+        releaseVoice(voice);
+        return;
+    }
+    const Voice::PendingNote& p = voice.pending;
+    startVoice(voice, p.hz, p.vol, p.pan, p.phase, p.detune, p.elapsed);
 }
 
 void FMSynth::cleanVoicePool()
 {
-    for(Voice& voice: voices){
-        if(voice.inUse && voice.osc.isDone()){
-            voice.inUse = false;
-            voice.osc.reset();
-            --voicesUsed;
+    for(uint8_t i = voicesUsed; i-- > 0;){
+        Voice& voice = voices[activeVoices[i]];
+        //Stolen voices are kept until their new note starts
+        if(!voice.fadeRemaining && voice.osc.isDone()){
+            releaseVoice(voice);
         }
     }
 }
 
-FMOscillator* FMSynth::findFreeOscillator()
+FMSynth::Voice* FMSynth::findStealCandidate(uint32_t protectedAge)
 {
-    if(voicesUsed == voices.size()){
+    if(stealMode == STEAL_NONE){
+        return nullptr;
+    }
+    Voice* best = nullptr;
+    for(uint8_t i = 0; i < voicesUsed; ++i){
+        Voice& voice = voices[activeVoices[i]];
+        if(voice.fadeRemaining || voice.age >= protectedAge){
+            continue;
+        }
+        bool better = !best;
+        if(best){
+            if(stealMode == STEAL_QUIETEST){
+                better = voice.osc.getLevel() < best->osc.getLevel();
+            }else if(stealMode == STEAL_RELEASED_FIRST && voice.osc.isReleased() != best->osc.isReleased()){
+                better = voice.osc.isReleased();
+            }else{
+                better = voice.age < best->age;
+            }
+        }
+        if(better){
+            best = &voice;
+        }
+    }
+    return best;
+}
+
+FMSynth::Voice* FMSynth::findFreeVoice(uint32_t protectedAge)
+{
+    if(voicesUsed >= nPolyphony || !freeVoices){
         //Attempt cleanup
         cleanVoicePool();
-        if(voicesUsed == voices.size()){
-            //Still no osc aviable
-            return nullptr;
-        }
     }
-    for(Voice& voice : voices){
-        if(!voice.inUse){
-            voice.inUse = true;
-            ++voicesUsed;
-            return &(voice.osc);
-        }
+    if(voicesUsed < nPolyphony && freeVoices){
+        //Highest free voice, this is a single CLZ on the Cortex-M4
+        const uint8_t idx = 31 - __builtin_clz(freeVoices);
+        freeVoices &= ~(1u << idx);
+        Voice& voice = voices[idx];
+        voice.inUse = true;
+        voice.age = voiceAge++;
+        voice.activeIndex = voicesUsed;
+        activeVoices[voicesUsed++] = idx;
+        //A held key may still point to the voice if its note has ended
+        detachVoice(voice);
+        return &voice;
     }
-    return nullptr;
+
+    Voice* victim = findStealCandidate(protectedAge);
+    if(!victim){
+        return nullptr;
+    }
+    //The key holding the stolen voice must not release the new note
+    detachVoice(*victim);
+    victim->fadeRemaining = VOICE_STEAL_FADE;
+    victim->age = voiceAge++;
+    ++stolenVoices;
+    return victim;
 }
 
 FMSynth::~FMSynth()
@@ -113,52 +218,69 @@ void FMSynth::notePressedEvent(uint8_t midiVal, uint8_t velocity)
     if(isMono){
         //Monophonic mode enabled
 
-        auto key = midiKeyEvents.front();
+        const uint32_t used = ~freeKeys & poolMask;
+        if(!used){
+            //No key held
+            PlayNote(midiVal, velocity);
+            return;
+        }
+        KeyEvent& key = keyEvents[__builtin_ctz(used)];
         if(isLegato){
             //Update involved oscillators
             float newFreq = calcHzFromMidi(midiVal);
             for(uint8_t i = 0; i < key.nVoices; ++i){
-                FMOscillator* voice = key.voices[i];
-                voice->overrideFrequency(newFreq);
-                voice->setDetune(globalDetune);
+                if(!key.voices[i]){
+                    continue;
+                }
+                FMEngine& osc = key.voices[i]->osc;
+                osc.overrideFrequency(newFreq);
+                osc.setDetune(globalDetune);
             }
             key.note = midiVal;
             key.velocity = velocity; //Set velocity to make the key event releasable. The oscillator loudness is not updated.
         }else{
             //Release previous held key
             noteReleasedEvent(key.note, 0xFFU);
-            KeyEvent& newEvent = midiKeyEvents.emplace_back(midiVal, velocity, unison+1);
-            PlayNote(newEvent);
+            PlayNote(midiVal, velocity);
         }
     }else{
         //Polyphonic mode
         if(voicesUsed >= nPolyphony){
-              //No free voice left, ignore event
+            //Try to free finished voices first
+            cleanVoicePool();
+        }
+        if(voicesUsed >= nPolyphony && !findStealCandidate()){
+              //No free voice left and nothing to steal, ignore event
+              ++droppedNotes;
               return;
         }
-        KeyEvent& newEvent = midiKeyEvents.emplace_back(midiVal, velocity, unison+1);
-        PlayNote(newEvent);
+        PlayNote(midiVal, velocity);
     }
 }
 
 void FMSynth::noteReleasedEvent(uint8_t key, uint8_t velocity)
 {
     bool allRelease = true;//(velocity > 127 || velocity == 0);
-    for(auto it = midiKeyEvents.begin(); it != midiKeyEvents.end(); ++it){
-        if(it->note == key && (allRelease || it->velocity == velocity)){
+    for(uint32_t used = ~freeKeys & poolMask; used; used &= used - 1){
+        KeyEvent& event = keyEvents[__builtin_ctz(used)];
+        if(event.note == key && (allRelease || event.velocity == velocity)){
             //Let the Oscillators stop playing
-            for(uint8_t i = 0; i < it->nVoices; ++i){
-                FMOscillator* osc = it->voices[i];
-                osc->eventReleased();
+            for(uint8_t i = 0; i < event.nVoices; ++i){
+                Voice* voice = event.voices[i];
+                if(!voice || !voice->inUse){
+                    //Voice was stolen, never started or its note has ended
+                    continue;
+                }
+                if(voice->fadeRemaining){
+                    //Note has not started yet
+                    voice->pending.released = true;
+                }else{
+                    voice->osc.eventReleased();
+                }
             }
 
             //Delete the Keyevent
-            auto ref = it;
-            //Shift iterator away, as only iterators to the deleted element get invalidated.
-            ++it;
-            midiKeyEvents.erase(ref);
-            //shift iterator back, this is done to not skip an element in the iteration
-            --it;
+            freeKeyEvent(event);
         }
     }
     cleanVoicePool();
@@ -167,28 +289,159 @@ void FMSynth::noteReleasedEvent(uint8_t key, uint8_t velocity)
 float FMSynth::getSample(bool isLeftChannel)
 {
     float sum = 0.f;
-    for(Voice& vc : voices){
-        if(vc.inUse && !vc.osc.isDone()){
+    for(uint8_t i = 0; i < voicesUsed; ++i){
+        Voice& vc = voices[activeVoices[i]];
+        if(vc.fadeRemaining){
+            sum += vc.osc.generateSample(isLeftChannel) * vc.fadeRemaining * (1.f/VOICE_STEAL_FADE);
+        }else if(!vc.osc.isFinished()){
             sum += vc.osc.generateSample(isLeftChannel);
         }
     }
     return sum;
 }
 
+void FMSynth::renderVoice(Voice& voice, float* left, float* right, size_t n, bool isLeftChannel, uint8_t factor)
+{
+    const float delta = sampleDelta / factor;
+    size_t done = 0;
+    if(voice.fadeRemaining){
+        //Render the stolen note with a linear fade out, the fade is counted in output samples
+        float tmpL[RENDER_BLOCK_SIZE];
+        float tmpR[RENDER_BLOCK_SIZE];
+        const float fadeStep = 1.f/(VOICE_STEAL_FADE * factor);
+        while(done < n && voice.fadeRemaining){
+            const size_t fade = voice.fadeRemaining * factor;
+            size_t m = n - done;
+            m = m < fade ? m : fade;
+            m = m < RENDER_BLOCK_SIZE ? m : RENDER_BLOCK_SIZE;
+            for(size_t i = 0; i < m; ++i){
+                tmpL[i] = 0.f;
+                tmpR[i] = 0.f;
+            }
+            if(right){
+                voice.osc.renderBlock(tmpL, tmpR, m, delta);
+            }else{
+                voice.osc.renderBlock(tmpL, m, delta, isLeftChannel);
+            }
+            for(size_t i = 0; i < m; ++i){
+                const float gain = (fade - i) * fadeStep;
+                left[done + i] += tmpL[i] * gain;
+                if(right){
+                    right[done + i] += tmpR[i] * gain;
+                }
+            }
+            voice.fadeRemaining -= m / factor;
+            done += m;
+        }
+        if(!voice.fadeRemaining){
+            finishSteal(voice);
+        }
+    }
+    if(done < n && voice.inUse && !voice.osc.isFinished()){
+        if(right){
+            voice.osc.renderBlock(left + done, right + done, n - done, delta);
+        }else{
+            voice.osc.renderBlock(left + done, n - done, delta, isLeftChannel);
+        }
+    }
+}
+
+void FMSynth::renderBlock(float* out, size_t n, bool isLeftChannel)
+{
+    updateParams(n);
+    if(oversampling > 1){
+        renderOversampled(out, nullptr, n, isLeftChannel);
+        return;
+    }
+    for(size_t i = 0; i < n; ++i){
+        out[i] = 0.f;
+    }
+    for(uint8_t i = voicesUsed; i-- > 0;){
+        renderVoice(voices[activeVoices[i]], out, nullptr, n, isLeftChannel, 1);
+    }
+}
+
+void FMSynth::renderBlock(float* left, float* right, size_t n)
+{
+    updateParams(n);
+    if(oversampling > 1){
+        renderOversampled(left, right, n, true);
+        return;
+    }
+    for(size_t i = 0; i < n; ++i){
+        left[i] = 0.f;
+        right[i] = 0.f;
+    }
+    for(uint8_t i = voicesUsed; i-- > 0;){
+        renderVoice(voices[activeVoices[i]], left, right, n, true, 1);
+    }
+}
+
+void FMSynth::renderOversampled(float* left, float* right, size_t n, bool isLeftChannel)
+{
+    //The voice sum is rendered in chunks of one render block at the high rate
+    float bufL[RENDER_BLOCK_SIZE];
+    float bufR[RENDER_BLOCK_SIZE];
+    //The mono render uses the filter state of its channel
+    const uint8_t chL = right || isLeftChannel ? 0 : 1;
+    const size_t chunk = RENDER_BLOCK_SIZE / oversampling;
+    for(size_t done = 0; done < n; done += chunk){
+        const size_t m = n - done < chunk ? n - done : chunk;
+        const size_t len = m * oversampling;
+        for(size_t i = 0; i < len; ++i){
+            bufL[i] = 0.f;
+            bufR[i] = 0.f;
+        }
+        for(uint8_t i = voicesUsed; i-- > 0;){
+            renderVoice(voices[activeVoices[i]], bufL, right ? bufR : nullptr, len, isLeftChannel, oversampling);
+        }
+        if(oversampling == 4){
+            preDecimators[chL].process(bufL, bufL, 2*m);
+            if(right){
+                preDecimators[1].process(bufR, bufR, 2*m);
+            }
+        }
+        decimators[chL].process(bufL, left + done, m);
+        if(right){
+            decimators[1].process(bufR, right + done, m);
+        }
+    }
+}
+
+void FMSynth::setOversampling(uint8_t factor)
+{
+    factor = factor >= 4 ? 4 : (factor >= 2 ? 2 : 1);
+    if(factor == oversampling){
+        return;
+    }
+    oversampling = factor;
+    for(uint8_t ch = 0; ch < 2; ++ch){
+        preDecimators[ch].reset();
+        decimators[ch].reset();
+    }
+    //The envelope segments were calculated for the old time increment
+    for(uint8_t i = 0; i < voicesUsed; ++i){
+        voices[activeVoices[i]].osc.retimeEnvelopes();
+    }
+}
+
 void FMSynth::setDetune(float cents)
 {
     globalDetune = cents;
-    for(Voice& vc: voices){
-        if(vc.inUse){
-            vc.osc.setDetune(cents);
-        }
+    for(uint8_t i = 0; i < voicesUsed; ++i){
+        Voice& vc = voices[activeVoices[i]];
+        vc.osc.setDetune(cents);
+        vc.pending.detune = cents;
     }
 }
 
 void FMSynth::incrementPhases(float delta){
-    for(Voice& vc : voices){
-        if(vc.inUse){
-            vc.osc.incrementPhase(delta);
+    updateParams(1);
+    for(uint8_t i = voicesUsed; i-- > 0;){
+        Voice& vc = voices[activeVoices[i]];
+        vc.osc.incrementPhase(delta);
+        if(vc.fadeRemaining && --vc.fadeRemaining == 0){
+            finishSteal(vc);
         }
     }
 }
@@ -21,11 +21,30 @@
 
 #include "fm_defines.h"
 #include "FMOscillator.h"
+#include "FMOscillatorQ15.h"
+#include "fm_algorithms.h"
+#include "ModSchedule.h"
 #include "OSCParam.h"
+#include "control_rate.h"
+#include "HalfbandDecimator.h"
 #include <cstdint>
 #include <vector>
-#include <list>
 
+#if FM_FIXED_POINT
+typedef FMOscillatorQ15 FMEngine; /**< Voice engine used by the synth. */
+#else
+typedef FMOscillator FMEngine; /**< Voice engine used by the synth. */
+#endif
+
+/**
+ * \brief Policy used when a note is pressed and no voice is free.
+ */
+enum VoiceStealMode : uint8_t {
+    STEAL_NONE = 0,       /**< Drop the new note. */
+    STEAL_OLDEST,         /**< Steal the voice which was started first. */
+    STEAL_QUIETEST,       /**< Steal the voice with the lowest level. */
+    STEAL_RELEASED_FIRST  /**< Steal the oldest released voice, or the oldest voice if none is released. */
+};
 
 /** \brief Class Coordinating the different Oscillators.
  *
@@ -38,6 +57,18 @@ class FMSynth
     float centerTune = 440.f; /**< Center Tuning for the Synth in Hz. */
     float globalDetune = 0.f; /**< Global Detune in Cents. */
     float globalVolume = 1.f; /**< Global Volume. */
+    float sampleDelta = 1000.f/SAMPLE_RATE; /**< Time increment per sample in ms. */
+    uint8_t oversampling = 1; /**< Oversampling factor of renderBlock(), 1, 2 or 4. */
+
+    /**
+     * \brief Decimation filters of the oversampled render, index 0 is the left and 1 the right channel.
+     *
+     * 2x only uses the long filters, 4x decimates with the short filters first.
+     */
+    HalfbandDecimator<HALFBAND_SHORT_PAIRS> preDecimators[2] = {HalfbandDecimator<HALFBAND_SHORT_PAIRS>(halfbandShort),
+                                                                HalfbandDecimator<HALFBAND_SHORT_PAIRS>(halfbandShort)};
+    HalfbandDecimator<HALFBAND_LONG_PAIRS> decimators[2] = {HalfbandDecimator<HALFBAND_LONG_PAIRS>(halfbandLong),
+                                                            HalfbandDecimator<HALFBAND_LONG_PAIRS>(halfbandLong)};
 
     bool isMono = false; /**< Whether playing in monophonic or in polyphonic mode. */
     bool isLegato = false; /**< Only relevant if Mono is enabled. */
@@ -65,18 +96,84 @@ class FMSynth
     float modMatrix[N_OSC*N_OSC] = {0.f};
     float outputVols[N_OSC] = {0.f}; /**< The output volumes of the individual oscillators. */
     float outputPans[N_OSC] = {1.f}; /**< The output panning of the individual oscillators. */
+
+    /**
+     * \brief Targets of the modulation matrix, the output volumes and pannings.
+     *
+     * The setters only change the targets. The arrays read by the voices are
+     * moved towards them once per render block by updateParams(), so CC changes do not click.
+     * Within a block the values are constant, so a change arrives in small steps of
+     * RENDER_BLOCK_SIZE samples (1.6ms at 20kHz). The per sample API steps every sample.
+     */
+    SmoothedParam modParams[N_OSC*N_OSC];
+    SmoothedParam volParams[N_OSC];
+    SmoothedParam panParams[N_OSC];
     OSCParam oscParams[N_OSC];      /**< The Parameters for the different oscillators. */
+    uint8_t algorithm = FM_ALGO_FREE; /**< The operator topology, see fm_algorithms.h. */
+    ModSchedule schedule; /**< The compiled modulation matrix of the selected algorithm. */
+    uint8_t nOperators = N_OSC; /**< Number of operators the free routing may use. */
+
+    /**
+     * \brief Recompiles the modulation schedule after a routing or algorithm change.
+     *
+     * The free routing may use the first nOperators operators, a fixed algorithm its own edges.
+     */
+    inline void compileSchedule(){
+        if(algorithm == FM_ALGO_FREE){
+            schedule.compile(modMatrix, outputVols, fmOperatorEdges(nOperators), fmOperatorCarriers(nOperators));
+        }else{
+            schedule.compile(modMatrix, outputVols, fmAlgorithmEdges(algorithm), fmAlgorithmCarriers(algorithm));
+        }
+    }
+
+
+    /**
+     * \brief Moves the modulation depths, output volumes and pannings one block closer to their targets.
+     *
+     * The schedule is recompiled if a path is switched on or has faded out completely.
+     *
+     * \param[in] n The number of samples in the block.
+     */
+    void updateParams(size_t n);
 
 
+    static constexpr uint8_t NO_KEY = 0xFF; /**< Key index of a voice which belongs to no key event. */
+
     /*
      * \brief Structure containing info for a voice.
      */
     struct Voice{
         bool inUse = false; /**< Indicates whether the Voice is being Used or not. */
-        FMOscillator osc; /**< The audio generator for the voice. */
+        FMEngine osc; /**< The audio generator for the voice. */
+        uint32_t age = 0; /**< Allocation order, lower values were started earlier. */
+        uint8_t activeIndex = 0; /**< Position in activeVoices while the voice is in use. */
+        uint8_t keyIndex = NO_KEY; /**< The key event holding the voice, NO_KEY if none. */
+        uint8_t keySlot = 0; /**< Position of the voice in the voices of its key event. */
+
+        /**
+         * \brief Remaining samples of the fade out if the voice was stolen.
+         *
+         * While fading the old note keeps playing with a falling gain,
+         * the new note is started when the fade is done.
+         */
+        uint16_t fadeRemaining = 0;
 
-        Voice(float* modulationMatrix, OSCParam* oscData, float* volumes, float* pans)
-            : inUse(false), osc(modulationMatrix, oscData, volumes, pans)
+        /**
+         * \brief Parameters of the note started after the fade.
+         */
+        struct PendingNote{
+            float hz;
+            float vol;
+            float pan;
+            float phase;
+            float detune;
+            float elapsed;
+            bool released; /**< The key was released before the note started. */
+        } pending = {};
+
+        Voice(float* modulationMatrix, OSCParam* oscData, float* volumes, float* pans, const uint8_t* algo,
+              const ModSchedule* sched)
+            : inUse(false), osc(modulationMatrix, oscData, volumes, pans, algo, sched)
         {}
     };
 
@@ -84,6 +181,24 @@ class FMSynth
     std::vector<Voice> voices; /**< Voice Pool. */
     uint8_t voicesUsed = 0; /**< Number of Voices in active use. */
 
+    /**
+     * \brief Dense list of the indices of the voices in use, the first voicesUsed entries are valid.
+     *
+     * Only changed when a voice is allocated or released, so the render loops never touch idle voices.
+     * A released voice is replaced by the last entry. The loops walk the list backwards, then a voice
+     * released during the loop is replaced by one which was already visited.
+     */
+    uint8_t activeVoices[MAX_POLYPHONY];
+    /**
+     * \brief Bitmask with one bit for every entry of the voice and key event pools.
+     */
+    static constexpr uint32_t poolMask = (MAX_POLYPHONY == 32) ? ~0u : (1u << MAX_POLYPHONY) - 1;
+    uint32_t freeVoices = poolMask; /**< Bitmask of the free voices, bit i is voice i. */
+    uint32_t voiceAge = 0; /**< Counter for the allocation order of the voices. */
+    VoiceStealMode stealMode = STEAL_RELEASED_FIRST; /**< What to do if no voice is free. */
+    uint32_t droppedNotes = 0; /**< Number of note presses that could not be played. */
+    uint32_t stolenVoices = 0; /**< Number of voices which were stolen for a new note. */
+
     /**
      * \brief Structure keeping a midi Key event in memory.
      *
@@ -95,42 +210,140 @@ class FMSynth
         uint8_t note; /** The pressed midi note. */
         uint8_t velocity; /** The velocity of the pressed note. */
         uint8_t nVoices; /** Number of the involved voices. */
-        FMOscillator** voices; /** An Array of pointer to the involved voices. */
+        uint8_t nAttached; /** Number of the voices which are not nullptr. */
+        Voice* voices[MAX_POLYPHONY]; /** The involved voices, stolen or missing voices are nullptr. */
+    };
 
-        /**
-         * \brief Creates a KeyEvent Class.
-         *
-         * It preallocates a pointerarray for nVoices. The pointers have to be added manually.
-         */
-        KeyEvent(uint8_t n, uint8_t vel, uint8_t nVoices)
-            : note(n), velocity(vel), nVoices(nVoices)
-        {
-            voices = new FMOscillator*[nVoices];
+    /**
+     * \brief Pool of the held keys.
+     *
+     * Every key event holds at least one voice and a voice belongs to one key event at most,
+     * so there can not be more key events than voices. Key events which lose their last
+     * voice are freed. Note presses never allocate memory, they are handled in the MIDI interrupt.
+     */
+    KeyEvent keyEvents[MAX_POLYPHONY];
+    uint32_t freeKeys = poolMask; /**< Bitmask of the free key events, bit i is keyEvents[i]. */
+
+    /**
+     * \brief Takes a key event from the pool, nullptr if the pool is empty.
+     */
+    inline KeyEvent* allocKeyEvent(uint8_t note, uint8_t velocity, uint8_t nVoices){
+        if(!freeKeys){
+            return nullptr;
+        }
+        const uint8_t idx = 31 - __builtin_clz(freeKeys);
+        freeKeys &= ~(1u << idx);
+        KeyEvent& key = keyEvents[idx];
+        key.note = note;
+        key.velocity = velocity;
+        key.nVoices = nVoices;
+        key.nAttached = 0;
+        for(uint8_t i = 0; i < nVoices; ++i){
+            key.voices[i] = nullptr;
         }
+        return &key;
+    }
 
-        ~KeyEvent(){
-            delete[] voices;
+    /**
+     * \brief Stores a voice in slot i of a key event.
+     */
+    inline void attachVoice(KeyEvent& key, uint8_t i, Voice& voice){
+        key.voices[i] = &voice;
+        ++key.nAttached;
+        voice.keyIndex = static_cast<uint8_t>(&key - keyEvents);
+        voice.keySlot = i;
+    }
+
+    /**
+     * \brief Returns a key event to the pool, its voices no longer belong to a key.
+     */
+    inline void freeKeyEvent(KeyEvent& key){
+        for(uint8_t i = 0; i < key.nVoices; ++i){
+            if(key.voices[i]){
+                key.voices[i]->keyIndex = NO_KEY;
+            }
         }
-    };
+        freeKeys |= 1u << (&key - keyEvents);
+    }
 
-        //uint16_t midiKeyEvents[MAX_POLYPHONY]
-    std::list<KeyEvent> midiKeyEvents;
+    /**
+     * \brief Removes a voice from the key event holding it, the key event is freed with its last voice.
+     *
+     * Used when a voice is (re)allocated, so a late note off does not release the new note.
+     * The voice knows its key event, so this takes constant time.
+     */
+    void detachVoice(Voice& voice);
 
+    /**
+     * \brief Starts the voices for a pressed key and stores them in a new key event.
+     */
+    void PlayNote(uint8_t note, uint8_t velocity, float elapsed=0.f);
 
-    void PlayNote(KeyEvent& info, float elapsed=0.f);
 
+    /**
+     * \brief Finds the next free Voice.
+     *
+     * The free voices are kept in a bitmask, so a free voice is found with a
+     * single count leading zeros. If there are currently no voices marked as free,
+     * then a cleanup is attempted. If still nothing is found a voice is stolen
+     * according to the steal mode. The stolen voice fades out before it plays the
+     * new note. If nothing can be stolen, a nullptr is returned.
+     *
+     * \warning Marks the returned voice as used.
+     *
+     * \param protectedAge Voices started at or after this allocation age are not stolen.
+     *
+     * \return The pointer to the Voice, or nullptr if search failed.
+     */
+    Voice* findFreeVoice(uint32_t protectedAge=~0u);
 
     /**
-     * \brief Finds the next free Oscillator.
+     * \brief Picks the voice to steal, nullptr if there is none.
      *
-     * If there are currently no voices marked as free, then a cleanup is
-     * attempted. If still nothing is found, a nullptr is returned.
+     * \param protectedAge Voices started at or after this allocation age are not stolen.
+     */
+    Voice* findStealCandidate(uint32_t protectedAge=~0u);
+
+    /**
+     * \brief Starts a note on a voice.
      *
-     * \warning Marks the returned oscillator as used.
+     * If the voice is fading out, the note is started after the fade.
+     */
+    void startVoice(Voice& voice, float hz, float vol, float pan, float phase, float detune, float elapsed);
+
+    /**
+     * \brief Ends the fade of a stolen voice and starts its pending note.
+     */
+    void finishSteal(Voice& voice);
+
+    /**
+     * \brief Marks a voice as free.
+     */
+    inline void releaseVoice(Voice& voice){
+        voice.inUse = false;
+        voice.fadeRemaining = 0;
+        voice.osc.reset();
+        freeVoices |= 1u << (&voice - voices.data());
+        const uint8_t last = activeVoices[--voicesUsed];
+        activeVoices[voice.activeIndex] = last;
+        voices[last].activeIndex = voice.activeIndex;
+    }
+
+    /**
+     * \brief Renders a voice, applying the fade out if it was stolen.
      *
-     * \return The pointer to the Oscillator, or nullptr if search failed.
+     * right is nullptr for the mono render.
+     *
+     * \param[in] factor The oversampling factor, n counts samples at the high rate.
+     */
+    void renderVoice(Voice& voice, float* left, float* right, size_t n, bool isLeftChannel, uint8_t factor);
+
+    /**
+     * \brief Renders the voice sum at the oversampled rate and decimates it to the output rate.
+     *
+     * right is nullptr for the mono render.
      */
-    FMOscillator* findFreeOscillator();
+    void renderOversampled(float* left, float* right, size_t n, bool isLeftChannel);
 
     /**
      * \brief Calculates the frequency of the midi note.
@@ -181,7 +394,9 @@ public:
     void setDetune(float cents);
 
     /*
-        * \brief Sets the modulation amount of the modulator for the carrier.
+        * \brief Sets the target modulation amount of the modulator for the carrier.
+        *
+        * The depth used by the voices follows it block by block, see modParams.
         *
         * \param[in] carrier The oscillator id of the carrier.
         * \param[in] modulator The oscillator id of the modulator.
@@ -189,24 +404,26 @@ public:
         */
        inline void setMod(uint8_t carrier, uint8_t modulator, float modAmount){
            if(carrier < N_OSC && modulator < N_OSC){
-               modMatrix[carrier * N_OSC + modulator] = modAmount;
+               modParams[carrier * N_OSC + modulator].set(modAmount);
            }
        }
 
        /*
-        * \brief Sets the Output Volume for the Oscillator.
+        * \brief Sets the target Output Volume for the Oscillator.
+        *
+        * Oscillators without a path to the output are not evaluated once their volume has faded out.
         *
         * \param[in] oscillator The oscillator id.
         * \param[in] vol The volume to be set. Must be >= 0.
         */
        inline void setOutputVolume(uint8_t oscillator, float vol){
            if(vol >= 0.f && oscillator < N_OSC){
-               outputVols[oscillator] = vol;
+               volParams[oscillator].set(vol);
            }
        }
 
        /*
-        * \brief Sets the panning of the output.
+        * \brief Sets the target panning of the output.
         *
         * \param[in] oscillator The oscillator id.
         * \param[in] pan The panning. Clamped into the range [-1, 1].
@@ -214,10 +431,47 @@ public:
        inline void setOutputPan(uint8_t oscillator, float pan){
                if(oscillator < N_OSC){
                    //Clamp panning between -1 and 1
-                   outputVols[oscillator] = (pan < -1.f) * -1.f + (pan > 1.f) * 1.f + (pan <= 1.f && pan >= -1.f) * pan;
+                   panParams[oscillator].set((pan < -1.f) * -1.f + (pan > 1.f) * 1.f + (pan <= 1.f && pan >= -1.f) * pan);
                }
        }
 
+       /*
+        * \brief Selects the operator topology.
+        *
+        * With a fixed algorithm the voices use an unrolled version of the operator graph.
+        * Only the edges and carriers of the algorithm are used, the depths and volumes
+        * still come from setMod() and setOutputVolume(). FM_ALGO_FREE uses the whole
+        * modulation matrix.
+        *
+        * \param[in] algo The algorithm id, see FMAlgorithmId. Unknown ids are ignored.
+        */
+       inline void setAlgorithm(uint8_t algo){
+           if(algo < FM_N_ALGORITHMS && algo != algorithm){
+               algorithm = algo;
+               compileSchedule();
+           }
+       }
+
+       inline uint8_t getAlgorithm() const {return algorithm;}
+
+       /*
+        * \brief Sets the number of operators of the patch.
+        *
+        * Only the first n operators are used by the free routing, the others are
+        * neither evaluated nor advanced. The cost per sample depends on the used
+        * operators and modulation paths, not on N_OSC.
+        *
+        * \param[in] n The number of operators, between 1 and N_OSC.
+        */
+       inline void setOperatorCount(uint8_t n){
+           if(n >= 1 && n <= N_OSC){
+               nOperators = n;
+               compileSchedule();
+           }
+       }
+
+       inline uint8_t getOperatorCount() const {return nOperators;}
+
        inline OSCParam& getParam(uint8_t oscillator){
            return oscParams[oscillator];
        }
@@ -238,6 +492,61 @@ public:
         */
        void incrementPhases(float delta);
 
+       /**
+        * \brief Renders a block of samples for the selected channel.
+        *
+        * This replaces calling getSample() and incrementPhases() for every sample.
+        * The voice pool is only walked once per block and each voice renders
+        * the whole block at once.
+        *
+        * \param[out] out The buffer to write the samples to. Must hold at least n samples.
+        * \param[in] n Number of samples to render.
+        * \param[in] isLeftChannel True if the samples are for the left channel, false if for the right.
+        */
+       void renderBlock(float* out, size_t n, bool isLeftChannel=true);
+
+       /**
+        * \brief Renders a block of stereo frames.
+        *
+        * Every voice evaluates its modulation chain once per frame for both channels.
+        *
+        * \param[out] left The buffer for the left channel. Must hold at least n samples.
+        * \param[out] right The buffer for the right channel. Must hold at least n samples.
+        * \param[in] n Number of frames to render.
+        */
+       void renderBlock(float* left, float* right, size_t n);
+
+       /**
+        * \brief Sets the sampling rate used by renderBlock().
+        *
+        * \param[in] rate The sampling rate in Hz.
+        */
+       inline void setSampleRate(uint32_t rate){
+           sampleDelta = 1000.f/rate;
+       }
+
+       /**
+        * \brief Sets the oversampling factor of renderBlock().
+        *
+        * With 2 or 4 the voices are rendered at a multiple of the sampling rate and decimated
+        * with half-band filters, so the sidebands of high modulation indices above the output Nyquist
+        * are removed instead of folding back. Costs about twice or four times the voice rendering,
+        * see the synth_render_block_os benchmarks. getSample() always renders at 1x.
+        * Can be changed while notes play, their envelope segments are recalculated for the new rate.
+        *
+        * \param[in] factor 1, 2 or 4. Other values are rounded down.
+        */
+       void setOversampling(uint8_t factor);
+
+       inline uint8_t getOversampling() const {return oversampling;}
+
+       /**
+        * \brief Returns the coefficient to smooth parameters over a block of n samples.
+        */
+       inline float getSmoothingCoef(size_t n) const {
+           return smoothingCoef(n, sampleDelta);
+       }
+
        /**
         * \brief Enables or disables the monotonic mode.
         *
@@ -250,6 +559,28 @@ public:
        void setLegato(bool val){
           isLegato = val;
        }
+
+       /**
+        * \brief Returns the number of voices currently marked as used.
+        */
+       inline uint8_t getVoicesUsed() const {return voicesUsed;}
+
+       /**
+        * \brief Returns how many note presses were dropped because no voice was free.
+        */
+       inline uint32_t getDroppedNotes() const {return droppedNotes;}
+
+       /**
+        * \brief Returns how many voices were stolen for new notes.
+        */
+       inline uint32_t getStolenVoices() const {return stolenVoices;}
+
+       /**
+        * \brief Selects what happens if a note is pressed while all voices are used.
+        */
+       inline void setStealMode(VoiceStealMode mode){stealMode = mode;}
+
+       inline VoiceStealMode getStealMode() const {return stealMode;}
 };
 
 #endif /* FMSYNTH_H_ */
@@ -0,0 +1,80 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "FMVoiceState.h"
+
+void FMVoiceState::resetState()
+{
+    elapsed = 0.f;
+    frequency = 0.f;
+    releasepoint = 1e8;
+    detune = 0.f;
+    precalcDetuneFac = 1.f;
+
+    globalVol = 1.f;
+    globalPan = 0.f;
+    precalcVolLeft = .5f;
+    precalcVolRight = .5f;
+
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        envs[i].stop();
+        envRamps[i].jumpTo(0.f);
+    }
+
+    isInit = false;
+    finished = true;
+}
+
+void FMVoiceState::initState(float freq, float oscVol, float oscPan)
+{
+    frequency = freq;
+    releasepoint = 1e8;
+    globalVol = oscVol;
+    globalPan = oscPan;
+
+    //Precalculate values
+    precalcVolLeft = oscVol * .25f * (-oscPan + 1.f); //0.25 instead of .5 to account for the factor of 2 in the generateSample function
+    precalcVolRight = oscVol * .25f * (oscPan + 1.f);
+
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        envs[i].start();
+        envRamps[i].jumpTo(0.f);
+    }
+    controlLeft = 0;
+
+    isInit = true;
+    finished = false;
+}
+
+bool FMVoiceState::isDone() const
+{
+    if(!isInit || finished){
+        return true;
+    }
+    //Only carriers which reach the output keep the voice alive
+    const uint8_t algo = algorithmId();
+    const uint32_t carriers = (algo == FM_ALGO_FREE && schedule) ? schedule->carrierMask : fmAlgorithmCarriers(algo);
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        //The ramp reaches 0 one control period after the release
+        const bool silent = envs[i].isDone() && envRamps[i].get() == 0.f;
+        if((carriers & fmCarrier(i)) && output_volumes[i] > 1e-3 && !silent){
+            return false;
+        }
+    }
+    return true;
+}
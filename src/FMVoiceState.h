@@ -0,0 +1,221 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef FMVOICESTATE_H_
+#define FMVOICESTATE_H_
+
+#include "fm_defines.h"
+#include "fm_algorithms.h"
+#include "ModSchedule.h"
+#include "OSCParam.h"
+#include "control_rate.h"
+#include <cmath>
+#include <cstdint>
+
+/**
+ * \brief State and control logic shared by the voice engines.
+ *
+ * FMOscillator and FMOscillatorQ15 only differ in how the samples are generated.
+ * The note state, the envelopes evaluated at control rate and the done checks
+ * live here, the engines derive from this class and add the phases and the render loop.
+ */
+class FMVoiceState
+{
+protected:
+    float* modmat; /**< Pointer to the modulation matrix*/
+    float* output_volumes; /**< Volumes of the oscillators for the final output. */
+    OSCParam* data; /**< Pointer to the Oscillator informations.*/
+    float* output_pan; /**< Panning value for the output oscillators. 0 is center, -1 left and 1 right.*/
+    const uint8_t* algorithm; /**< Pointer to the selected algorithm id, nullptr for free routing. */
+    const ModSchedule* schedule; /**< Compiled modulation matrix of the selected algorithm, nullptr to compile it per block. */
+
+    float frequency; /**< Frequency of the oscillator. */
+
+    float elapsed; /**< Elapsed time since sounding in ms.*/
+    float releasepoint; /**< Timepoint of when the note was released. */
+
+    float detune; /**< Oscillator detune amount in Cents. */
+    float precalcDetuneFac; /**< Precalculated detuning factor. */
+
+    float globalVol; /**< Global volume of this oscillator. */
+    float globalPan; /*< Global panning of this oscillator. */
+
+    float precalcVolLeft; /**< Precalculated global volume for the left channel. */
+    float precalcVolRight; /**< Precalculated global volume for the right channel. */
+
+    bool isInit = false; /**< Is the oscillator considered initialized or not. */
+    bool finished = true; /**< Set at the control point where all evaluated envelopes have faded out, or if not initialized. */
+
+    ADSREnvelope envs[N_OSC]; /**< Envelopes of the individual oscillators, one step per control period. */
+    ControlRamp envRamps[N_OSC]; /**< Envelope values ramped at audio rate. */
+    uint8_t controlLeft = 0; /**< Samples left until the next control point. */
+
+    FMVoiceState(float* modulationMatrix, OSCParam* oscData, float* volumes, float* pans,
+                 const uint8_t* algo, const ModSchedule* sched)
+        :modmat(modulationMatrix), output_volumes(volumes), data(oscData), output_pan(pans),
+         algorithm(algo), schedule(sched) {}
+
+    /**
+     * \brief Resets the note state and stops the envelopes, the engines reset their phases.
+     */
+    void resetState();
+
+    /**
+     * \brief Starts the envelopes and precalculates the volumes of a new note.
+     *
+     * \see FMOscillator::init()
+     */
+    void initState(float freq, float oscVol, float oscPan);
+
+    /**
+     * \brief Evaluates the control signals at a control point.
+     *
+     * The envelopes of all operators are advanced by one control period and ramped towards
+     * their new values, so an operator routed in during a note follows the note time.
+     * Only the ramps of the used operators are advanced per sample, the others start
+     * from their last control point value.
+     *
+     * \param[in] increment The time increment per sample in ms.
+     * \param[in] ops Mask of the used operators which decide if the voice has finished, see fmCarrier().
+     */
+    inline void updateControl(float increment, uint32_t ops){
+        const float tick = increment * CONTROL_PERIOD;
+        bool silent = true;
+        //All envelopes keep running, an operator routed in later is at the right point of its envelope
+        for(uint8_t i=0; i < N_OSC; ++i){
+            envs[i].prepare(data[i].adsr, tick);
+            envs[i].step(data[i].adsr, tick);
+            envRamps[i].rampTo(envs[i].getLevel());
+            if(ops & fmCarrier(i)){
+                silent &= envs[i].isDone() && envRamps[i].get() == 0.f;
+            }
+        }
+        //The ramps stay at 0 from here on
+        finished = silent;
+    }
+
+    /**
+     * \brief Advances the control ramps of the used operators by one sample.
+     *
+     * \param[in] ops Mask of the operators to update, see fmCarrier().
+     */
+    inline void advanceControl(uint32_t ops){
+        for(uint8_t i=0; i < N_OSC; ++i){
+            if(ops & fmCarrier(i)){
+                envRamps[i].advance();
+            }
+        }
+    }
+
+    /**
+     * \brief Returns the id of the selected algorithm.
+     */
+    inline uint8_t algorithmId() const {return algorithm ? *algorithm : FM_ALGO_FREE;}
+
+public:
+    /**
+     * \brief Checks if the oscillator produces any sound.
+     *
+     * Also returns true if the carriers which reach the output are muted.
+     */
+    bool isDone() const;
+
+    /**
+     * \brief Returns the cached done flag of the envelopes.
+     *
+     * Cheaper than isDone(), it is only updated at the control points and
+     * ignores the output volumes. Used to skip the voice in the render loop.
+     */
+    inline bool isFinished() const {return finished;}
+
+    /**
+     * \brief Sets the detuning amount of the oscillator.
+     *
+     * \param[in] cents The detuning amount in cents.
+     */
+    inline void setDetune(float cents) {detune = cents; precalcDetuneFac = powf(2.f, detune/1200.f);}
+
+    //cents to ratio formula: 2^(c/1200)
+    //this can be easily verified by solving 440 * 2^((note*100 - 4900 + c)/1200) * b = 440 * 2^((note-49)/12)
+    //for b
+
+    /**
+     * \brief Recalculates the running envelope segments for a new time increment per sample.
+     *
+     * Called when the oversampling factor changes during a note.
+     */
+    inline void retimeEnvelopes() {
+        for(uint8_t i = 0; i < N_OSC; ++i){
+            envs[i].retime();
+        }
+    }
+
+    /** \brief Marks the note as released to the oscillator.
+     *
+     * The currently stored timepoint will be used as the release timepoint.
+     *
+     * \note The storing of the timepoint will only take place if there is not one already set.
+     *       This is done to prevent continuous release calls which let the oscillator
+     *       play indefinitely.
+     */
+    inline void eventReleased() {
+        if(releasepoint > elapsed){
+            releasepoint = elapsed;
+        }
+        for(uint8_t i = 0; i < N_OSC; ++i){
+            envs[i].release();
+        }
+    }
+
+    inline float getElapsedTime() const {return elapsed;}
+
+    /**
+     * \brief Returns true if the note has been released.
+     */
+    inline bool isReleased() const {return releasepoint <= elapsed;}
+
+    /**
+     * \brief Estimates the current loudness from the carrier volumes and envelopes.
+     *
+     * The envelopes are the ramped values of the last rendered sample.
+     */
+    inline float getLevel() const {
+        float level = 0.f;
+        for(uint8_t i = 0; i < N_OSC; ++i){
+            level += output_volumes[i] * envRamps[i].get();
+        }
+        return level * globalVol;
+    }
+
+    /*
+     * \brief Sets a new elapsed time value.
+     *
+     * This can be used to enable legato playing.
+     */
+    inline void overrideTimePos(float newPos) {elapsed = newPos;}
+
+    /*
+     * \brief Sets a new frequency to be played.
+     *
+     * Updates the Oscillator to play a new frequency.
+     * This is useful for legato playing.
+     */
+    inline void overrideFrequency(float newFreq) {frequency = newFreq;}
+};
+
+#endif /* FMVOICESTATE_H_ */
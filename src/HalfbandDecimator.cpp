@@ -0,0 +1,33 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "HalfbandDecimator.h"
+
+//Kaiser window, beta 8.5
+const float halfbandLong[HALFBAND_LONG_PAIRS] = {
+    3.165685775e-01f, -1.009861597e-01f, 5.545552346e-02f, -3.462123406e-02f,
+    2.242426750e-02f, -1.450810594e-02f, 9.173208417e-03f, -5.575020944e-03f,
+    3.204668437e-03f, -1.708820400e-03f, 8.218471100e-04f, -3.395373681e-04f,
+    1.080426823e-04f, -1.725675294e-05f
+};
+
+//Kaiser window, beta 6
+const float halfbandShort[HALFBAND_SHORT_PAIRS] = {
+    3.079123161e-01f, -7.770894473e-02f, 2.555474339e-02f, -6.284506552e-03f,
+    5.263918436e-04f
+};
@@ -0,0 +1,111 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef HALFBANDDECIMATOR_H_
+#define HALFBANDDECIMATOR_H_
+
+#include "fm_defines.h"
+#include <cstddef>
+
+/*\file HalfbandDecimator.h
+ * \brief Polyphase half-band FIR filters halving the sampling rate.
+ *
+ * Used by the oversampled render path of FMSynth. A half-band filter is symmetric,
+ * its center tap is 0.5 and every second tap is zero. Evaluated at the output rate
+ * (polyphase) one branch is the delayed center tap, the other holds the nonzero taps,
+ * so an output sample costs one multiplication per pair of symmetric taps.
+ *
+ * The coefficients are Kaiser windowed sincs, normalized to unity gain at DC.
+ * The pass band is given at an output rate of 20kHz.
+ */
+
+#define HALFBAND_LONG_PAIRS 14 /**< 55 taps, flat to 8kHz, -84dB above 12kHz. */
+#define HALFBAND_SHORT_PAIRS 5 /**< 19 taps, -59dB in the bands folding below 10kHz. Only used as the first stage of 4x. */
+
+extern const float halfbandLong[HALFBAND_LONG_PAIRS]; /**< Nonzero taps of the long filter, from the center outwards. */
+extern const float halfbandShort[HALFBAND_SHORT_PAIRS]; /**< Nonzero taps of the short filter, from the center outwards. */
+
+/**
+ * \brief Half-band decimator by 2.
+ *
+ * \tparam Pairs Number of nonzero tap pairs, the filter has 4*Pairs-1 taps.
+ */
+template<size_t Pairs>
+class HalfbandDecimator
+{
+    static constexpr size_t TAPS = 4*Pairs - 1;
+    static constexpr size_t HISTORY = TAPS - 1;
+    static constexpr size_t CHUNK = RENDER_BLOCK_SIZE; /**< Input samples processed per pass. */
+
+    const float* coefs; /**< The nonzero taps from the center outwards. */
+    float history[HISTORY] = {0.f}; /**< The last inputs of the previous call. */
+
+public:
+    explicit HalfbandDecimator(const float* taps) : coefs(taps) {}
+
+    /**
+     * \brief Clears the filter state.
+     */
+    void reset(){
+        for(float& h : history){
+            h = 0.f;
+        }
+    }
+
+    /**
+     * \brief Filters and decimates 2*n input samples into n output samples.
+     *
+     * The output has a delay of TAPS/2 input samples. out may point to in,
+     * an output sample is written after the inputs it depends on are read.
+     *
+     * \param[in] in The input samples at the high rate.
+     * \param[out] out The output samples at half the rate.
+     * \param[in] n Number of output samples.
+     */
+    void process(const float* in, float* out, size_t n){
+        float work[HISTORY + CHUNK];
+        for(size_t i = 0; i < HISTORY; ++i){
+            work[i] = history[i];
+        }
+        while(n){
+            const size_t m = n < CHUNK/2 ? n : CHUNK/2;
+            for(size_t i = 0; i < 2*m; ++i){
+                work[HISTORY + i] = in[i];
+            }
+            for(size_t i = 0; i < m; ++i){
+                const float* center = work + 2*i + HISTORY/2;
+                float sum = .5f * center[0];
+                for(size_t k = 0; k < Pairs; ++k){
+                    sum += coefs[k] * (center[2*k + 1] + center[-static_cast<ptrdiff_t>(2*k + 1)]);
+                }
+                out[i] = sum;
+            }
+            for(size_t i = 0; i < HISTORY; ++i){
+                work[i] = work[2*m + i];
+            }
+            in += 2*m;
+            out += m;
+            n -= m;
+        }
+        for(size_t i = 0; i < HISTORY; ++i){
+            history[i] = work[i];
+        }
+    }
+};
+
+#endif /* HALFBANDDECIMATOR_H_ */
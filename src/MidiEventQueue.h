@@ -0,0 +1,166 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef MIDIEVENTQUEUE_H_
+#define MIDIEVENTQUEUE_H_
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * \brief Number of events the queue can hold, has to be a power of two.
+ */
+#ifndef MIDI_QUEUE_SIZE
+#define MIDI_QUEUE_SIZE 64
+#endif
+static_assert((MIDI_QUEUE_SIZE & (MIDI_QUEUE_SIZE - 1)) == 0, "MIDI_QUEUE_SIZE must be a power of two");
+
+/**
+ * \brief Kind of a queued MIDI event.
+ */
+enum MidiEventType : uint8_t {
+    MIDI_NOTE_ON = 0,    /**< data0 is the note, data1 the velocity. */
+    MIDI_NOTE_OFF,       /**< data0 is the note, data1 the velocity (255 for note on with velocity 0). */
+    MIDI_CC,             /**< data0 is the controller, data1 the 7 bit value. */
+    MIDI_PITCH_BEND      /**< data1 is the 14 bit value. */
+};
+
+/**
+ * \brief A parsed MIDI event with the time it was received.
+ */
+struct MidiEvent{
+    uint32_t time;      /**< Sample clock at which the event takes effect. */
+    MidiEventType type; /**< What happened. */
+    uint8_t data0;      /**< Note or controller number. */
+    uint16_t data1;     /**< Velocity, controller or pitch bend value. */
+};
+
+/**
+ * \brief Wait free single producer, single consumer ring of MIDI events.
+ *
+ * The UART interrupt parses the incoming bytes and pushes the events, the render
+ * loop pops them between two blocks. The queue is the event sink of the MidiParser. So the synth is only modified by the render
+ * loop and the interrupt stays short.
+ *
+ * The indices run freely and are only masked for the array access. Each index is
+ * written by one side only, the release store publishes the event to the other side.
+ */
+class MidiEventQueue
+{
+public:
+    /**
+     * \brief Time source for the pushed events, called with the context given to setClock().
+     *
+     * A plain function pointer, so stamping an event in the interrupt is a single direct call.
+     */
+    typedef uint32_t (*ClockFn)(void* context);
+
+private:
+    MidiEvent events[MIDI_QUEUE_SIZE];
+    std::atomic<uint32_t> head{0}; /**< Next slot to write, written by the producer. */
+    std::atomic<uint32_t> tail{0}; /**< Next slot to read, written by the consumer. */
+    uint32_t overflows = 0; /**< Events dropped because the queue was full, written by the producer. */
+
+    ClockFn clock = [](void*){return 0u;}; /**< Time source for the pushed events. */
+    void* clockContext = nullptr; /**< Argument of clock. */
+
+public:
+    /**
+     * \brief Adds an event, called by the producer only.
+     *
+     * \return false if the queue is full, the event is dropped then.
+     */
+    inline bool push(const MidiEvent& event){
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        if(h - tail.load(std::memory_order_acquire) == MIDI_QUEUE_SIZE){
+            ++overflows;
+            return false;
+        }
+        events[h & (MIDI_QUEUE_SIZE - 1)] = event;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * \brief Stamps an event with the current time and adds it.
+     */
+    inline bool push(MidiEventType type, uint8_t data0, uint16_t data1){
+        return push(MidiEvent{clock(clockContext), type, data0, data1});
+    }
+
+    /**
+     * \brief Takes the oldest event, called by the consumer only.
+     *
+     * \return false if the queue is empty.
+     */
+    inline bool pop(MidiEvent& event){
+        const uint32_t t = tail.load(std::memory_order_relaxed);
+        if(head.load(std::memory_order_acquire) == t){
+            return false;
+        }
+        event = events[t & (MIDI_QUEUE_SIZE - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * \brief Returns the oldest event without taking it, nullptr if the queue is empty.
+     *
+     * Called by the consumer only.
+     */
+    inline const MidiEvent* peek() const {
+        const uint32_t t = tail.load(std::memory_order_relaxed);
+        if(head.load(std::memory_order_acquire) == t){
+            return nullptr;
+        }
+        return &events[t & (MIDI_QUEUE_SIZE - 1)];
+    }
+
+    /**
+     * \brief Number of queued events.
+     */
+    inline uint32_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    inline bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * \brief Returns how many events were dropped because the queue was full.
+     */
+    inline uint32_t getOverflows() const {return overflows;}
+
+    /**
+     * \brief Sets the time source used to stamp the events.
+     *
+     * \param[in] fn The time source, captureless lambdas convert to it.
+     * \param[in] context Passed to fn on every call.
+     */
+    inline void setClock(ClockFn fn, void* context=nullptr) {clock = fn; clockContext = context;}
+
+    //Event sink interface of MidiParser
+    inline void noteOn(uint8_t note, uint8_t velocity) {push(MIDI_NOTE_ON, note, velocity);}
+    inline void noteOff(uint8_t note, uint8_t velocity) {push(MIDI_NOTE_OFF, note, velocity);}
+    inline void controlChange(uint8_t id, uint8_t val) {push(MIDI_CC, id, val);}
+    inline void controlChange14Bit(uint8_t, uint16_t) {} //Not used by the synth
+    inline void pitchBend(uint16_t val) {push(MIDI_PITCH_BEND, 0, val);}
+};
+
+#endif /* MIDIEVENTQUEUE_H_ */
@@ -19,40 +19,26 @@
 #ifndef MIDIPARSER_H_
 #define MIDIPARSER_H_
 
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 
-class MidiParser
+/**
+ * \brief Event sink forwarding the parsed events to std::function callbacks.
+ *
+ * This is the callback interface of the parser for users which want to attach the handlers at run time.
+ * Every event costs an indirect call, sinks with inline handlers avoid that.
+ */
+class FunctionSink
 {
-    uint8_t eventChannel = 0; /**< Midi Channel for which events will be generated. Numbers > 16 mean Omni mode. */
-
-    uint8_t lastUsed = 255; /**< Last used key or controller, used for running status. Below 128 means invalid.*/
-    uint8_t currentStatus = 0; /**< Saves the message type we are currently receiving. */
-    uint8_t nRead = 0; /**< Number of Data bytes read.*/
-    uint8_t expectedBytes = 0; /**< Number of Bytes expected for the message.*/
-    uint8_t buffer[2];  /**< Buffer for the Data Bytes in order to assemble a message.*/
-    uint8_t channel = 0; /**< The midi channel the message is received on. */
-    bool inSysEx = false; /**< Are we in a SysEx Message. */
-    bool ignoreBytes = false; /**< True if the received bytes should be ignored.*/
-
-    uint16_t tempCC[32]; /**< Temporary Buffer for 14 bit CC Values. Needed since two messages are required before value can be assembled.*/
-    uint8_t tempCCcounter[32]; /**< Counter to keep track which halves are still required.*/
-
-    bool midi2compliant = false; /**< If true turns midi 2.0 compliant mode on.*/
-
-    /*typedef void(*NoteOnEventFn)(uint8_t, uint8_t);
-    typedef void(*NoteOffEventFn)(uint8_t, uint8_t);
-    typedef void(*CCEvent7BitFn)(uint8_t, uint8_t);
-    typedef void(*CCEvent14BitFn)(uint8_t, uint16_t);
-    typedef void(*PitchBendEventFn)(uint16_t);*/
-
+public:
     typedef std::function<void(uint8_t, uint8_t)> NoteOnEventFn;
     typedef std::function<void(uint8_t, uint8_t)> NoteOffEventFn;
     typedef std::function<void(uint8_t, uint8_t)> CCEvent7BitFn;
     typedef std::function<void(uint8_t, uint16_t)> CCEvent14BitFn;
     typedef std::function<void(uint16_t)> PitchBendEventFn;
 
-
+private:
     NoteOnEventFn noteOnEvent;
     NoteOffEventFn noteOffEvent;
     CCEvent7BitFn CC7BitEvent;
@@ -60,12 +46,7 @@ class MidiParser
     PitchBendEventFn PitchBendEvent;
 
 public:
-    MidiParser(bool isMidi2 = false);
-    ~MidiParser();
-
-    void consumeByte(uint8_t msg);
-    void fireEvent();
-    void processCCEvent();
+    FunctionSink();
 
     void attachNoteOn(NoteOnEventFn fn) {noteOnEvent = fn;}
     void attachNoteOff(NoteOffEventFn fn) {noteOffEvent = fn;}
@@ -73,8 +54,308 @@ public:
     void attachCCEvent14Bit(CCEvent14BitFn fn) {CC14BitEvent = fn;}
     void attachPitchBendEvent(PitchBendEventFn fn) {PitchBendEvent = fn;}
 
+    inline void noteOn(uint8_t note, uint8_t velocity) {noteOnEvent(note, velocity);}
+    inline void noteOff(uint8_t note, uint8_t velocity) {noteOffEvent(note, velocity);}
+    inline void controlChange(uint8_t id, uint8_t val) {CC7BitEvent(id, val);}
+    inline void controlChange14Bit(uint8_t id, uint16_t val) {CC14BitEvent(id, val);}
+    inline void pitchBend(uint16_t val) {PitchBendEvent(val);}
+};
+
+/**
+ * \brief Kind of a MIDI byte, see MidiStatusTable.
+ *
+ * The channel message kinds are the upper nibble of the status byte minus 8.
+ */
+enum MidiByteKind : uint8_t {
+    MIDI_KIND_NOTE_OFF = 0,
+    MIDI_KIND_NOTE_ON,
+    MIDI_KIND_POLY_PRESSURE,
+    MIDI_KIND_CONTROL_CHANGE,
+    MIDI_KIND_PROGRAM_CHANGE,
+    MIDI_KIND_CHANNEL_PRESSURE,
+    MIDI_KIND_PITCH_BEND,
+    MIDI_KIND_SYSTEM_COMMON, /**< Cancels the running status, the data is skipped. */
+    MIDI_KIND_SYSEX_START,   /**< Data bytes are skipped until the next status byte. */
+    MIDI_KIND_REALTIME,      /**< Single byte, may appear anywhere, does not change the parser state. */
+    MIDI_KIND_DATA           /**< Data byte, below 0x80. */
+};
+
+/**
+ * \brief Lookup table from a byte to its kind and number of data bytes.
+ *
+ * Every entry is (kind << 2) | length. The table is generated at compile time and stored in flash.
+ */
+struct MidiStatusTable{
+    uint8_t entries[256];
+
+    static constexpr uint8_t entry(MidiByteKind kind, uint8_t length){
+        return static_cast<uint8_t>(kind << 2 | length);
+    }
+
+    constexpr MidiStatusTable() : entries() {
+        for(uint16_t i = 0; i < 0x80; ++i){
+            entries[i] = entry(MIDI_KIND_DATA, 0);
+        }
+        for(uint16_t i = 0x80; i < 0xF0; ++i){
+            const MidiByteKind kind = static_cast<MidiByteKind>((i >> 4) - 8);
+            //Program change and channel pressure only have one data byte
+            const bool single = kind == MIDI_KIND_PROGRAM_CHANGE || kind == MIDI_KIND_CHANNEL_PRESSURE;
+            entries[i] = entry(kind, single ? 1 : 2);
+        }
+        entries[0xF0] = entry(MIDI_KIND_SYSEX_START, 0);
+        entries[0xF1] = entry(MIDI_KIND_SYSTEM_COMMON, 1); //MIDI Time Code Quarter Frame
+        entries[0xF2] = entry(MIDI_KIND_SYSTEM_COMMON, 2); //Song Position Pointer
+        entries[0xF3] = entry(MIDI_KIND_SYSTEM_COMMON, 1); //Song Select
+        entries[0xF4] = entry(MIDI_KIND_SYSTEM_COMMON, 0); //Undefined(Reserved)
+        entries[0xF5] = entry(MIDI_KIND_SYSTEM_COMMON, 0); //Undefined(Reserved)
+        entries[0xF6] = entry(MIDI_KIND_SYSTEM_COMMON, 0); //Tune Request
+        entries[0xF7] = entry(MIDI_KIND_SYSTEM_COMMON, 0); //End of System Exclusive
+        for(uint16_t i = 0xF8; i < 0x100; ++i){
+            //Timing Clock, Start, Continue, Stop, Active Sensing, System Reset and the reserved ones
+            entries[i] = entry(MIDI_KIND_REALTIME, 0);
+        }
+    }
+
+    static constexpr MidiByteKind kind(uint8_t entry) {return static_cast<MidiByteKind>(entry >> 2);}
+    static constexpr uint8_t length(uint8_t entry) {return entry & 3;}
+};
+
+inline constexpr MidiStatusTable midiStatusTable{};
+
+/**
+ * \brief Parser for a MIDI byte stream.
+ *
+ * The parsed events are passed to the sink, which has to provide the methods
+ *
+ *     void noteOn(uint8_t note, uint8_t velocity);
+ *     void noteOff(uint8_t note, uint8_t velocity);
+ *     void controlChange(uint8_t id, uint8_t val);
+ *     void controlChange14Bit(uint8_t id, uint16_t val);
+ *     void pitchBend(uint16_t val);
+ *
+ * They are resolved at compile time and can be inlined into the parser, which keeps the
+ * time per byte in the UART interrupt short. FunctionSink offers std::function callbacks instead.
+ *
+ * Status bytes are classified with midiStatusTable. Running status is kept for the channel
+ * messages, system common messages cancel it, SysEx data is skipped until the next status
+ * byte and realtime bytes can be interleaved anywhere, also inside a message.
+ */
+template<typename Sink>
+class MidiParser
+{
+    Sink& sink; /**< Receives the parsed events. */
+
+    uint8_t eventChannel = 0; /**< Midi Channel for which events will be generated. Numbers > 16 mean Omni mode. */
+
+    uint8_t status = 0; /**< Table entry of the current (running) status. */
+    uint8_t channel = 0; /**< The midi channel the message is received on. */
+    uint8_t expectedBytes = 0; /**< Number of data bytes of the message, 0 if data bytes are skipped. */
+    uint8_t nRead = 0; /**< Number of Data bytes read.*/
+    uint8_t buffer[2];  /**< Buffer for the Data Bytes in order to assemble a message.*/
+
+    uint16_t tempCC[32]; /**< Temporary Buffer for 14 bit CC Values. Needed since two messages are required before value can be assembled.*/
+    uint8_t tempCCcounter[32] = {0}; /**< Counter to keep track which halves are still required.*/
+
+    bool midi2compliant = false; /**< If true turns midi 2.0 compliant mode on.*/
+
+    /**
+     * \brief Handles a status byte.
+     */
+    inline void consumeStatus(uint8_t msg){
+        const uint8_t entry = midiStatusTable.entries[msg];
+        const MidiByteKind kind = MidiStatusTable::kind(entry);
+        if(kind == MIDI_KIND_REALTIME){
+            //Does not interrupt the current message
+            return;
+        }
+        status = entry;
+        channel = msg & 0xF; //Channel number is in the second half of the byte
+        expectedBytes = MidiStatusTable::length(entry);
+        nRead = 0;
+    }
+
+    /**
+     * \brief Handles a data byte.
+     */
+    inline void consumeData(uint8_t msg){
+        if(!expectedBytes){
+            //No status, SysEx or a message without data
+            return;
+        }
+        buffer[nRead++] = msg;
+        if(nRead == expectedBytes){
+            nRead = 0;
+            if(MidiStatusTable::kind(status) == MIDI_KIND_SYSTEM_COMMON){
+                //No running status for system messages
+                expectedBytes = 0;
+                return;
+            }
+            fireEvent(MidiStatusTable::kind(status), buffer[0], buffer[1]);
+        }
+    }
+
+public:
+    MidiParser(Sink& eventSink, bool isMidi2 = false) : sink(eventSink), midi2compliant(isMidi2) {}
+
+    /**
+     * \brief Parses one byte.
+     */
+    inline void consumeByte(uint8_t msg){
+        if(msg & 128){
+            consumeStatus(msg);
+        }else{
+            consumeData(msg);
+        }
+    }
+
+    /**
+     * \brief Parses n bytes, e.g. a buffer filled by the DMA or read from a file.
+     *
+     * Gives the same events as calling consumeByte() for every byte. The parser state
+     * is kept in locals for the whole buffer and a run of data bytes is consumed
+     * without classifying every byte.
+     */
+    inline void consumeByte(const uint8_t* data, size_t n){
+        const uint8_t* const end = data + n;
+        uint8_t st = status;
+        uint8_t expected = expectedBytes;
+        uint8_t read = nRead;
+        while(data != end){
+            uint8_t msg = *data;
+            if(msg & 128){
+                const uint8_t entry = midiStatusTable.entries[msg];
+                //Realtime bytes do not interrupt the current message
+                if(MidiStatusTable::kind(entry) != MIDI_KIND_REALTIME){
+                    st = entry;
+                    channel = msg & 0xF;
+                    expected = MidiStatusTable::length(entry);
+                    read = 0;
+                }
+                ++data;
+                continue;
+            }
+            if(!expected){
+                //No status, SysEx or a message without data, skip up to the next status byte
+                while(data != end && !(*data & 128)){
+                    ++data;
+                }
+                continue;
+            }
+            //With running status a run of data bytes can hold several messages,
+            //complete ones are passed on straight from the input
+            if(!read && MidiStatusTable::kind(st) != MIDI_KIND_SYSTEM_COMMON){
+                while(static_cast<size_t>(end - data) >= expected && !(data[0] & 128)
+                      && !(data[expected - 1] & 128)){
+                    fireEvent(MidiStatusTable::kind(st), data[0], data[expected - 1]);
+                    data += expected;
+                }
+                if(data == end || (*data & 128)){
+                    continue;
+                }
+                msg = *data;
+            }
+            do{
+                buffer[read++] = msg;
+                ++data;
+                if(read == expected){
+                    read = 0;
+                    if(MidiStatusTable::kind(st) == MIDI_KIND_SYSTEM_COMMON){
+                        //No running status for system messages
+                        expected = 0;
+                        break;
+                    }
+                    fireEvent(MidiStatusTable::kind(st), buffer[0], buffer[1]);
+                }
+            }while(data != end && !((msg = *data) & 128));
+        }
+        status = st;
+        expectedBytes = expected;
+        nRead = read;
+    }
+
+    /**
+     * \brief Passes a complete message to the sink.
+     *
+     * \param[in] kind The kind of the current status.
+     * \param[in] data0 The first data byte.
+     * \param[in] data1 The second data byte, unused by messages with one data byte.
+     */
+    void fireEvent(MidiByteKind kind, uint8_t data0, uint8_t data1);
+    void processCCEvent(uint8_t id, uint8_t val);
+
+    inline Sink& getSink() {return sink;}
+
     inline uint8_t getChannel() const {return eventChannel;}
     inline void setChannel(uint8_t channel) {eventChannel = channel;}
 };
 
+template<typename Sink>
+void MidiParser<Sink>::fireEvent(MidiByteKind kind, uint8_t data0, uint8_t data1)
+{
+    if(eventChannel <= 16 && channel != eventChannel){
+        //Message not for our channel, ignore
+        return;
+    }
+    switch(kind){
+        case MIDI_KIND_NOTE_OFF:
+            sink.noteOff(data0, data1);
+            break;
+        case MIDI_KIND_NOTE_ON:
+            if (data1 == 0){
+                //Velocity of 0 equals NoteOff
+                sink.noteOff(data0, 255);
+            }else{
+                sink.noteOn(data0, data1);
+            }
+            break;
+        case MIDI_KIND_CONTROL_CHANGE:
+            processCCEvent(data0, data1);
+            break;
+        case MIDI_KIND_PITCH_BEND: {
+            uint16_t val = 0;
+            val |= data0; //lsb
+            val |= static_cast<uint16_t>(data1) << 7; //msb, shift by seven because we only get 7 bits per byte
+            sink.pitchBend(val);
+            break;
+        }
+        default:
+            //After Touch, Patch Change and Channel Pressure are not used
+            break;
+    }
+}
+
+template<typename Sink>
+void MidiParser<Sink>::processCCEvent(uint8_t id, uint8_t val){
+    if(id > 127){
+        //Invalid id, skip
+        return;
+    }
+    if(id < 64){
+        //14 Bit event received if midi 2.0
+        if(midi2compliant){
+            if(id < 32){
+                //Received MSB for a 14 bit Controller
+                tempCC[id] = static_cast<uint16_t>(val) << 7;
+                tempCCcounter[id] |= 0x2; //Set MSB set flag
+            }else{
+                id -= 32; //Shift id to the correct value
+                //LSB for a 14 bit Controller received
+                tempCC[id] &= 0xFF80; //Zero second half
+                tempCC[id] |= val; //Write LSB
+                tempCCcounter[id] |= 0x1; //Set LSB set flag
+            }
+            if(tempCCcounter[id] == 0x3){
+                //Both parts set, fire event
+                sink.controlChange14Bit(id, tempCC[id]);
+                tempCCcounter[id] = 0x0; //Clear flags
+            }
+        }else{
+            sink.controlChange(id, val);
+        }
+    }else{
+        //7 Bit event received
+        sink.controlChange(id, val);
+    }
+}
+
 #endif /* MIDIPARSER_H_ */
@@ -20,17 +20,23 @@
 #define MIDITASK_H_
 
 #include "MidiParser.h"
+#include "render_stats.h"
 #include "uart_msp432.h"
 #include "posix_io.h"
 
+template<typename Sink>
 class MidiTask
 {
-    MidiParser& midiParser;
+    MidiParser<Sink>& midiParser;
     uart_msp432 connection;
 
 public:
-    MidiTask(MidiParser& parser) : midiParser(parser) {
-        connection.uartAttachIrq([this](char c){midiParser.consumeByte(c);});
+    MidiTask(MidiParser<Sink>& parser) : midiParser(parser) {
+        connection.uartAttachIrq([this](char c){
+            PROFILE_START(midiStart);
+            midiParser.consumeByte(c);
+            PROFILE_END(midiStart, midi);
+        });
         connection.uartEnableIrq();
     }
     ~MidiTask() {
@@ -38,8 +44,8 @@ public:
         connection.uartDetachIrq();
     }
 
-    MidiParser& getParser() {return midiParser;}
-    const MidiParser& getParser() const { return midiParser;}
+    MidiParser<Sink>& getParser() {return midiParser;}
+    const MidiParser<Sink>& getParser() const { return midiParser;}
 
 
 };
@@ -0,0 +1,70 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ModSchedule.h"
+
+void ModSchedule::compile(const float* modmat, const float* volumes, uint64_t allowedEdges, uint32_t allowedCarriers)
+{
+    //Mark the carriers, then everything modulating a marked oscillator
+    bool used[N_OSC] = {false};
+    nCarriers = 0;
+    uint32_t mask = 0;
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        if(((allowedCarriers >> i) & 1) && volumes[i] != 0.f){
+            used[i] = true;
+            carriers[nCarriers++] = i;
+            mask |= 1u << i;
+        }
+    }
+
+    carrierMask = mask;
+
+    bool changed = true;
+    while(changed){
+        changed = false;
+        for(uint8_t i = 0; i < N_OSC*N_OSC; ++i){
+            const uint8_t carrier = i / N_OSC;
+            const uint8_t modulator = i % N_OSC;
+            if(used[carrier] && !used[modulator] && ((allowedEdges >> i) & 1) && modmat[i] != 0.f){
+                used[modulator] = true;
+                changed = true;
+            }
+        }
+    }
+
+    mask = 0;
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        mask |= (uint32_t)used[i] << i;
+    }
+    operatorMask = mask;
+
+    //Same order as the matrix scan, from the last to the first row
+    uint8_t n = 0;
+    for(int8_t i = N_OSC; i > 0; --i){
+        for(uint8_t j = 0; j < N_OSC; ++j){
+            const uint8_t idx = (i-1)*N_OSC + j;
+            if(used[i-1] && ((allowedEdges >> idx) & 1) && modmat[idx] != 0.f){
+                edges[n].index = idx;
+                edges[n].carrier = i-1;
+                edges[n].modulator = j;
+                ++n;
+            }
+        }
+    }
+    nEdges = n;
+}
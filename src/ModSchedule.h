@@ -0,0 +1,68 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef MODSCHEDULE_H_
+#define MODSCHEDULE_H_
+
+#include "fm_defines.h"
+#include <cstdint>
+
+/**
+ * \brief Compact evaluation order of the modulation matrix.
+ *
+ * The schedule holds the non zero edges of the modulation matrix in the
+ * order of the matrix scan (last to first row) and the list of carriers.
+ * Operators which neither reach the output directly nor through
+ * other operators are left out, so the voices only pay for the routing
+ * which is actually used.
+ *
+ * It is recompiled whenever the routing changes, not per sample. The depths
+ * are read from the matrix, so changing a non zero depth keeps the schedule valid.
+ */
+struct ModSchedule
+{
+    /**
+     * \brief One modulation edge.
+     */
+    struct Edge{
+        uint8_t index;     /**< Index of the modulation depth in the matrix, carrier*N_OSC+modulator. */
+        uint8_t carrier;   /**< The modulated oscillator. */
+        uint8_t modulator; /**< The modulating oscillator. */
+    };
+
+    Edge edges[N_OSC*N_OSC]; /**< The edges in evaluation order. */
+    uint8_t nEdges = 0;      /**< Number of used edges. */
+
+    uint8_t carriers[N_OSC]; /**< The oscillators sent to the output. */
+    uint8_t nCarriers = 0;   /**< Number of carriers. */
+    uint32_t carrierMask = 0; /**< The carriers as mask, see fmCarrier(). */
+
+    uint32_t operatorMask = 0; /**< All oscillators which have to be evaluated, see fmCarrier(). */
+
+    /**
+     * \brief Compiles the schedule.
+     *
+     * \param[in] modmat The modulation matrix, N_OSC*N_OSC entries.
+     * \param[in] volumes The output volumes, N_OSC entries.
+     * \param[in] allowedEdges Edges which may be used, bit carrier*N_OSC+modulator.
+     * \param[in] allowedCarriers Oscillators which may be carriers.
+     */
+    void compile(const float* modmat, const float* volumes, uint64_t allowedEdges=~0ull, uint32_t allowedCarriers=~0u);
+};
+
+#endif /* MODSCHEDULE_H_ */
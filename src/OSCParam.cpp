@@ -16,4 +16,4 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
-float empty_osc_fn(float) {return 0.f;}
+float empty_osc_fn(float, float) {return 0.f;}
@@ -20,6 +20,7 @@
 #define OSCPARAM_H_
 
 #include <cmath>
+#include <cstdint>
 
 /**\brief Struct containing the ADSR info.
  *
@@ -32,9 +33,19 @@
  * Oscillator will continuously hold the note volume until the note is released.
  * The release paramater represents how long it takes the oscillator volume to
  * revert to 0 after a note off event was received.
+ *
+ * This struct only holds the patch settings and is shared by all voices,
+ * the per voice state lives in ADSREnvelope.
  */
 struct ADSRParam{
 
+    /** \brief Overshoot of the attack target, smaller values give a more convex attack. */
+    static constexpr float ATTACK_RATIO = .3f;
+    /** \brief Remaining fraction of the decay after the decay time. */
+    static constexpr float DECAY_RATIO = 1e-3f;
+    /** \brief Undershoot of the release target, the release ends at 0 after the release time. */
+    static constexpr float RELEASE_RATIO = 1e-3f;
+
 private:
     float attack = 1e-5;  /*< Attack time in ms. */
     float decay =  1e-5;  /*< Decay time in ms. */
@@ -42,12 +53,9 @@ private:
     float release = 1e-5; /*< Release time in ms. */
 
     //PRECALCULATED VALUES
-    float a_steepness = 0.f;
-    float d_steepness = 0.f;
-    float r_steepness = 0.f;
-    float r_val = sustain;
-
-    float t_ad = 0.f;
+    float a_rate = 0.f; /*< Logarithmic attack rate per ms. */
+    float d_rate = 0.f; /*< Logarithmic decay rate per ms. */
+    float r_rate = 0.f; /*< Logarithmic release rate per ms. */
 public:
 
     inline void setAttack(float a){attack = a; precalc();}
@@ -55,80 +63,207 @@ public:
     inline void setSustain(float s){sustain = s; precalc();}
     inline void setRelease(float r){release = r; precalc();}
 
+    inline float getSustain() const {return sustain;}
+    inline float getAttackRate() const {return a_rate;}
+    inline float getDecayRate() const {return d_rate;}
+    inline float getReleaseRate() const {return r_rate;}
+
     /**
-     * \brief Recalculates the slope values.
+     * \brief Precalculates the segment rates.
      *
-     * This Method is needed when the note is released before the decay is
-     * finished. This will make it so that the Note releases from the
-     * last held value.
+     * This is done because a division costs 14 Cycles opposed to 1-2 cycles with multiplication in MSP432.
+     * Each segment approaches its target exponentially, the rate is the natural logarithm
+     * of the distance ratio covered by the segment per ms.
      */
-    inline void fastReleaseUpdate(float last_held){
-        r_val = last_held;
-        if(release > 1e-3){
-            r_steepness = -r_val/release;
-        }
+    void precalc(){
+        a_rate = logf((1.f + ATTACK_RATIO)/ATTACK_RATIO) / (attack > 1e-3f ? attack : 1e-3f);
+        d_rate = -logf(DECAY_RATIO) / (decay > 1e-3f ? decay : 1e-3f);
+        r_rate = logf((1.f + RELEASE_RATIO)/RELEASE_RATIO) / (release > 1e-3f ? release : 1e-3f);
     }
+};
+
+/**
+ * \brief Per voice envelope state.
+ *
+ * The envelope is a state machine which advances by one multiply-add per step:
+ * level = level * coef + base. The voices step it once per control period and
+ * ramp the result at audio rate (control_rate.h). Each segment approaches its target exponentially
+ * like the RC circuit of an analog envelope generator.
+ *  - The attack aims above 1 so it reaches 1 after the attack time with a convex curve.
+ *  - The decay falls towards the sustain level and stays there until the release.
+ *  - The release aims slightly below 0 and ends at 0, a release from a lower level is shorter.
+ *
+ * The coefficients and the length of a segment in steps are calculated once when it
+ * starts, so changes of the times take effect with the next segment. Sustain changes
+ * are picked up by prepare().
+ */
+class ADSREnvelope{
+public:
+    enum Stage : uint8_t {ENV_ATTACK, ENV_DECAY, ENV_RELEASE, ENV_DONE};
+
+private:
+    float level = 0.f; /**< Current envelope value. */
+    float coef = 1.f; /**< Multiplier of the current segment. */
+    float base = 0.f; /**< Offset of the current segment. */
+    uint32_t remaining = 0; /**< Steps left in the current segment, 0 if the segment has not been entered yet. */
+    Stage stage = ENV_DONE; /**< Current segment. */
 
     /**
-     * \brief Precalculates steepness values.
+     * \brief Calculates the coefficients of a segment approaching target.
      *
-     * This is done because a division costs 14 Cycles opposed to 1-2 cycles with multiplication in MSP432.
+     * \param[in] rate The logarithmic rate of the segment per ms.
+     * \param[in] target The value the segment approaches.
+     * \param[in] increment The time increment per step in ms.
      */
-    void precalc(){
-        if(attack > 1e-3){
-            a_steepness = 1/attack;
+    inline void setSegment(float rate, float target, float increment){
+        coef = expf(-rate * increment);
+        base = target * (1.f - coef);
+    }
+
+    /**
+     * \brief Calculates the number of steps until the segment reaches end.
+     *
+     * \param[in] rate The logarithmic rate of the segment per ms.
+     * \param[in] target The value the segment approaches.
+     * \param[in] end The value at which the segment ends. Must lie between the level and the target.
+     * \param[in] increment The time increment per step in ms.
+     */
+    inline void setLength(float rate, float target, float end, float increment){
+        const float n = logf((target - level)/(target - end)) / (rate * increment);
+        remaining = n < 1.f ? 1 : (n < 4e9f ? (uint32_t)ceilf(n) : UINT32_MAX);
+    }
+
+    /**
+     * \brief Enters the current stage.
+     */
+    void enterStage(const ADSRParam& param, float increment){
+        switch(stage){
+        case ENV_ATTACK:
+            setSegment(param.getAttackRate(), 1.f + ADSRParam::ATTACK_RATIO, increment);
+            setLength(param.getAttackRate(), 1.f + ADSRParam::ATTACK_RATIO, 1.f, increment);
+            break;
+        case ENV_DECAY:
+            //The decay never ends on its own, it holds the sustain level
+            setSegment(param.getDecayRate(), param.getSustain(), increment);
+            remaining = UINT32_MAX;
+            break;
+        case ENV_RELEASE:
+            setSegment(param.getReleaseRate(), -ADSRParam::RELEASE_RATIO, increment);
+            setLength(param.getReleaseRate(), -ADSRParam::RELEASE_RATIO, 0.f, increment);
+            break;
+        default:
+            level = 0.f;
+            coef = 1.f;
+            base = 0.f;
+            remaining = UINT32_MAX;
+            break;
         }
-        if(decay > 1e-3){
-            d_steepness = (sustain-1)/decay;
+    }
+
+    /**
+     * \brief Ends the current segment at its exact end value and enters the next one.
+     */
+    void nextStage(const ADSRParam& param, float increment){
+        if(stage == ENV_ATTACK){
+            level = 1.f;
+            stage = ENV_DECAY;
+        }else if(stage == ENV_RELEASE){
+            level = 0.f;
+            stage = ENV_DONE;
         }
-        if(release > 1e-3){
-            r_steepness = -r_val/release;
+        enterStage(param, increment);
+    }
+
+public:
+    /**
+     * \brief Starts the attack from 0.
+     */
+    inline void start(){
+        level = 0.f;
+        stage = ENV_ATTACK;
+        remaining = 0;
+    }
+
+    /**
+     * \brief Starts the release from the current level.
+     */
+    inline void release(){
+        if(stage < ENV_RELEASE){
+            stage = ENV_RELEASE;
+            remaining = 0;
         }
+    }
 
-        t_ad = attack + decay;
+    /**
+     * \brief Stops the envelope immediately.
+     */
+    inline void stop(){
+        level = 0.f;
+        stage = ENV_DONE;
+        remaining = 0;
     }
 
     /**
-     * \brief Calculates the ADS Volume Value.
+     * \brief Recalculates the current segment from the current level on the next prepare().
      *
-     * Evaluates the ADSR Function. The attack is linearly increasing until 1,
-     * the decay linearly decreases until sustain and sustain stays flat until
-     * the note release.
-     * The note release is a linear decay.
-     *
-     * The time positions are relative to the note start.
-     *
-     * \warning To avoid NaN values the time parameter should not directly be zero but very small numbers.
+     * Needed if the time increment per step changes during a segment.
+     */
+    inline void retime(){
+        remaining = 0;
+    }
+
+    /**
+     * \brief Prepares the envelope for the next step.
      *
-     * \param[in] timepos The time position for the evaluation in ms.
-     * \param[in] releaseTime Timepoint in ms when the Note was released. Infinity by default.
+     * Enters a newly started segment and follows changes of the sustain level.
      *
-     * \return The ADSR Value.
+     * \param[in] param The settings of the envelope.
+     * \param[in] increment The time increment per step in ms. Nothing is done if it is 0.
      */
-    float calc_vol (float timepos, float releaseTime=1e9){
-        const bool in_a = (timepos < attack);
-        const bool in_d = !in_a && timepos < (t_ad);
-        const bool in_s = !in_d && timepos < releaseTime;
-        const bool in_r = timepos >= releaseTime && timepos <= (releaseTime + release);
-        return   (in_a) * timepos * a_steepness \
-                +(in_d) * (1+ d_steepness * (timepos - attack)) \
-                +(in_s) * sustain \
-                +(in_r) * (r_steepness * (timepos - releaseTime) + r_val);
+    inline void prepare(const ADSRParam& param, float increment){
+        if(increment <= 0.f){
+            return;
+        }
+        if(!remaining){
+            enterStage(param, increment);
+        }else if(stage == ENV_DECAY){
+            base = param.getSustain() * (1.f - coef);
+        }
     }
 
-    /**\brief Returns whether the sound has reached a volume of zero or not.
+    /**
+     * \brief Advances the envelope by one step.
      *
+     * \warning prepare() must have been called with the same increment beforehand.
      */
-    float isDone(float timepos, float releaseTime){
-        return timepos > releaseTime + release;
+    inline void step(const ADSRParam& param, float increment){
+        level = level * coef + base;
+        if(!--remaining){
+            nextStage(param, increment);
+        }
     }
+
+    inline float getLevel() const {return level;}
+
+    inline Stage getStage() const {return stage;}
+
+    /**\brief Returns whether the envelope has reached a volume of zero after the release or not.
+     *
+     */
+    inline bool isDone() const {return stage == ENV_DONE;}
 };
 
-float empty_osc_fn(float);
+float empty_osc_fn(float, float);
 
 struct OSCParam
 {
-    typedef float(*osc_fn)(float);
+    /**
+     * \brief Oscillator evaluator.
+     *
+     * Takes the phase in [0, 1] and the phase increment per sample. Only the band limited
+     * oscillators use the increment, the others ignore it.
+     */
+    typedef float(*osc_fn)(float phase, float dt);
     osc_fn oscillator = &empty_osc_fn; /**< Oscillator evaluator. */
     float ratio = 1.f; /** < Frequency Ratio; */
     float vol = 1.f;  /** < Global Volume of the Oscillator */
@@ -138,7 +273,7 @@ struct OSCParam
 /**
  * \brief Evaluator that does nothing. Used for the empty OSCParam.
  */
-inline float dummy_evaluator(float){return 0.f;}
+inline float dummy_evaluator(float, float = 0.f){return 0.f;}
 
 //const OSCParam __emptyOSC = {&dummy_evaluator, 0.f, 0.f, 0.f};
 
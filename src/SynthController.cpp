@@ -0,0 +1,202 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "SynthController.h"
+#include "oscillators.h"
+#include "render_stats.h"
+#include <cmath>
+
+void SynthController::loadDefaultPatch()
+{
+    synth.setMono(false);
+    //synth.setLegato(true);
+    synth.setMod(0, 1, 2.0f);
+    synth.setOutputVolume(0, 1.f);
+    OSCParam& mod1 = synth.getParam(0);
+    mod1.ratio = 1.f;
+    mod1.oscillator = &sine;
+    mod1.adsr.setAttack(20.f);
+    mod1.adsr.setSustain(1.f);
+    mod1.adsr.setDecay(800.f);
+    mod1.adsr.setRelease(20.f);
+
+    OSCParam& mod2 = synth.getParam(1);
+    mod2.ratio = 2.f;
+    mod2.oscillator = &triangle;
+    mod2.adsr.setAttack(10.f);
+    mod2.adsr.setDecay(700.f);
+    mod2.adsr.setSustain(0.7f);
+}
+
+/**
+ * \brief Selects the waveform for a CC value.
+ *
+ * Saw and square are the band limited versions.
+ */
+static OSCParam::osc_fn waveformFromCC(uint8_t val)
+{
+    if(val < 32) {
+        return &sine;
+    }else if (val < 64) {
+        return &triangle;
+    }else if (val < 96) {
+        return &saw_blep;
+    }
+    return &square_blep;
+}
+
+void SynthController::controlChange(uint8_t id, uint8_t val)
+{
+    OSCParam& mod1 = synth.getParam(0);
+    OSCParam& mod2 = synth.getParam(1);
+
+    // Modulation Parameters
+    if(id == 11){
+        synth.setMod(0, 0, val/127.f * 3.f);
+    }else if(id == 12){
+        synth.setMod(0, 1, .3f+val/127.f * 3.f);
+    }else if(id == 13){
+        synth.setMod(1, 0, val/127.f * 3.f);
+    }else if(id == 14){
+        synth.setMod(1, 1, val/127.f * 3.f);
+    }else if(id == 15){
+        //Output Parameters
+        synth.setOutputVolume(0, val/127.f);
+    }else if(id == 16){
+        synth.setOutputVolume(1, val/127.f);
+    }else if(id == 17){
+        //Vol
+        vol.set(val/64.f);
+    }else if(id == 18){
+        bc_val = 30*(uint16_t)val + 1;
+        ibc_val = 1.f/(float)bc_val;
+    }else if (id == 19) {
+        //OSC 0 Attack
+        mod1.adsr.setAttack(std::exp(val/100.f) * 7000.f - 7000.f);
+    }else if (id == 20) {
+        //OSC 0 Decay
+        mod1.adsr.setDecay(std::exp(val/100.f) * 7000.f - 7000.f);
+    }else if (id == 21) {
+        //OSC 0 Sustain
+        mod1.adsr.setSustain(val/127.f);
+    }else if (id == 22) {
+        //OSC 0 Release
+        mod1.adsr.setRelease(std::exp(val/100.f) * 7000.f - 7000.f);
+    }else if (id == 23) {
+        //OSC 1 Attack
+        mod2.adsr.setAttack(std::exp(val/100.f) * 7000.f - 7000.f);
+    }else if (id == 24) {
+        //OSC 1 Decay
+        mod2.adsr.setDecay(std::exp(val/100.f) * 7000.f - 7000.f);
+    }else if (id == 25) {
+        //OSC 1 Sustain
+        mod2.adsr.setSustain(val/127.f);
+    }else if (id == 26) {
+        //OSC 1 Release
+        mod2.adsr.setRelease(std::exp(val/100.f) * 7000.f - 7000.f);
+    }else if (id == 27) {
+        //OSC 0 Waveform
+        mod1.oscillator = waveformFromCC(val);
+    }else if (id == 28) {
+        //OSC 1 Waveform
+        mod2.oscillator = waveformFromCC(val);
+    }else if (id == 29) {
+        //Algorithm
+        synth.setAlgorithm(val * FM_N_ALGORITHMS / 128);
+    }else if (id == 30) {
+        //OSC 0 Ratio
+        //2^((val-63)/16)
+        mod1.ratio = std::pow(2.f, (val -63.f)/16);
+    }else if (id == 31) {
+        //OSC 1 Ratio
+        mod2.ratio = std::pow(2.f, (val -63.f)/16);
+    }else if (id == 32) {
+        //Oversampling 1x, 2x or 4x
+        synth.setOversampling(val < 43 ? 1 : (val < 86 ? 2 : 4));
+    }
+}
+
+void SynthController::pitchBend(uint16_t val)
+{
+    float b = (val/8192.f - 1.f)*1200.f;
+    synth.setDetune(b);
+}
+
+void SynthController::attach(FunctionSink& sink)
+{
+    sink.attachNoteOn([this](uint8_t a, uint8_t b){
+        synth.notePressedEvent(a, b);
+    });
+
+    sink.attachNoteOff([this](uint8_t a, uint8_t b){
+        synth.noteReleasedEvent(a, b);
+    });
+
+    sink.attachCCEvent7Bit([this](uint8_t id, uint8_t val){
+        controlChange(id, val);
+    });
+
+    sink.attachPitchBendEvent([this](uint16_t val){
+        pitchBend(val);
+    });
+}
+
+void SynthController::dispatch(const MidiEvent& event)
+{
+    switch(event.type){
+        case MIDI_NOTE_ON:
+            synth.notePressedEvent(event.data0, event.data1);
+            break;
+        case MIDI_NOTE_OFF:
+            synth.noteReleasedEvent(event.data0, event.data1);
+            break;
+        case MIDI_CC:
+            controlChange(event.data0, event.data1);
+            break;
+        case MIDI_PITCH_BEND:
+            pitchBend(event.data1);
+            break;
+    }
+}
+
+void SynthController::renderBlock(float* out, size_t n, MidiEventQueue& queue, uint32_t clock)
+{
+    vol.update(synth.getSmoothingCoef(n));
+    size_t done = 0;
+    while(const MidiEvent* next = queue.peek()){
+        //Offset of the event in this block, negative if it is late
+        const int32_t offset = static_cast<int32_t>(next->time - clock);
+        if(offset > 0 && offset >= static_cast<int32_t>(n)){
+            break;
+        }
+        if(offset > static_cast<int32_t>(done)){
+            //Render up to the event
+            synth.renderBlock(out + done, offset - done, false);
+            done = offset;
+        }
+#if FM432_PROFILE
+        renderStats.midiLate.add(done - offset);
+#endif
+        MidiEvent event = *next;
+        queue.pop(event);
+        dispatch(event);
+    }
+    if(done < n){
+        synth.renderBlock(out + done, n - done, false);
+    }
+}
@@ -0,0 +1,112 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SYNTHCONTROLLER_H_
+#define SYNTHCONTROLLER_H_
+
+#include "FMSynth.h"
+#include "MidiParser.h"
+#include "MidiEventQueue.h"
+#include "control_rate.h"
+#include <cstdint>
+
+/**
+ * \brief Maps MIDI events onto the synth parameters.
+ *
+ * Contains the default patch, the CC mapping documented in the README and the
+ * output stage (global volume, limiting and bitcrusher). It is shared by the
+ * firmware and the host tools, so both sound the same.
+ */
+class SynthController
+{
+    FMSynth& synth;
+
+    SmoothedParam vol; /**< Global output volume, smoothed per rendered block. */
+
+    //Bitcrusher values
+    uint16_t bc_val = 1;
+    float ibc_val = 1.f;
+
+public:
+    SynthController(FMSynth& fmSynth) : synth(fmSynth) {vol.jumpTo(1.f);}
+
+    /**
+     * \brief Sets up the default two oscillator patch.
+     */
+    void loadDefaultPatch();
+
+    /**
+     * \brief Handles a 7 bit MIDI CC event.
+     *
+     * \param[in] id The controller number.
+     * \param[in] val The controller value.
+     */
+    void controlChange(uint8_t id, uint8_t val);
+
+    /**
+     * \brief Handles a pitch bend event.
+     *
+     * \param[in] val The 14 bit pitch bend value, 8192 is the center.
+     */
+    void pitchBend(uint16_t val);
+
+    /**
+     * \brief Attaches the note, CC and pitch bend callbacks to a parser sink.
+     */
+    void attach(FunctionSink& sink);
+
+    /**
+     * \brief Applies an event taken from a MidiEventQueue.
+     */
+    void dispatch(const MidiEvent& event);
+
+    /**
+     * \brief Renders n mono samples and applies the queued events at their sample position.
+     *
+     * The block is split at every event, so the events take effect at the exact sample.
+     * Events which are already due are applied at the start of the block, also if n is 0.
+     * Events after the block stay in the queue. The global volume is smoothed once per call.
+     *
+     * \param[out] out The rendered samples.
+     * \param[in] n Number of samples.
+     * \param[in] queue The pending MIDI events.
+     * \param[in] clock The sample clock of out[0], same time base as MidiEvent::time.
+     */
+    void renderBlock(float* out, size_t n, MidiEventQueue& queue, uint32_t clock);
+
+    /**
+     * \brief Applies the global volume and the limiter.
+     */
+    inline float applyVolume(float val) const {
+        return clampSignal(vol.get() * val);
+    }
+
+    /**
+     * \brief Applies the output stage and converts the sample to PCM.
+     *
+     * \param[in] val The sample produced by the synth.
+     * \param[in] scale The PCM value for full scale.
+     *
+     * \return The volume adjusted, limited and bitcrushed PCM value.
+     */
+    inline int16_t toPCM(float val, float scale) const {
+        return bc_val * static_cast<int16_t>(applyVolume(val) * scale * ibc_val);
+    }
+};
+
+#endif /* SYNTHCONTROLLER_H_ */
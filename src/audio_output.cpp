@@ -14,11 +14,173 @@
 
 #include "audio_output.h"
 
+#if FM432_BLOCK_DMA
+
+// The DMA interrupt needs to find its audio_output
+static audio_output * _block_output = nullptr;
+
+// Fills in one DMA task writing a single byte to a register. Tasks
+// marked as wait only continue with the next task on the next trigger.
+static void set_byte_task(DMA::CH_CTRL_DATA & task, volatile void * src, volatile void * dst,
+                          bool wait, bool last = false) {
+    task.SRC_DATA_END_PTR = src;
+    task.DST_DATA_END_PTR = dst;
+    task.CTRL.SRC_INC     = DMA::NO_INCREMENT;
+    task.CTRL.SRC_SIZE    = DMA::BYTE;
+    task.CTRL.DST_INC     = DMA::NO_INCREMENT;
+    task.CTRL.DST_SIZE    = DMA::BYTE;
+    task.CTRL.R_POWER     = DMA::ARB_AFTER_4;
+    task.CTRL.N_MINUS_1   = 0;
+    if (last)
+        task.CTRL.CYCLE_CTRL = DMA::CYCLE_BASIC;
+    else if (wait)
+        task.CTRL.CYCLE_CTRL = DMA::CYCLE_PER_SCATTER_GATHER_ALT;
+    else
+        task.CTRL.CYCLE_CTRL = DMA::CYCLE_MEM_SCATTER_GATHER_ALT;
+}
+
+audio_output::audio_output()
+    : _audio_en (PORT_PIN(5,0)),
+      _audio_cs (PORT_PIN(5,2)),
+      _audio_spi(EUSCI_B0_SPI, _audio_cs),
+      _half_state{HALF_PLAYING, HALF_FREE}, _dma_half(0), _half_fresh(false), _fill_half(1),
+      _timer_period(PCM_TIMER_CLOCK / 1000),
+      _sample_clock(0), _current_run(0), _playing(false),
+      _zero(0), _one(BIT2)
+{
+    // Configure BoostXL-audio objects
+    _audio_en.gpioMode(GPIO::OUTPUT);
+    _audio_spi.setSpeed(24000000);
+    enable_output(true);
+
+    // Setup the task lists of both halves. Every sample uses the same
+    // four tasks as the per sample mode. The first three tasks of a
+    // sample run through, the last one waits for the next timer trigger.
+    // The last task of a half is a basic transfer, which ends the run
+    // and raises the DMA interrupt.
+    for (uint8_t half = 0; half < 2; ++half) {
+        for (uint16_t i = 0; i < AUDIO_HALF_BLOCK; ++i) {
+            DMA::CH_CTRL_DATA * t = &_block_tasks[half][i * 4];
+            uint8_t * sample = (uint8_t *)&_samples[half][i];
+            bool last = (i == AUDIO_HALF_BLOCK - 1);
+
+            set_byte_task(t[0], &_zero,     &P5->OUT,             false);
+            set_byte_task(t[1], sample + 1, &EUSCI_B0_SPI->TXBUF, false);
+            set_byte_task(t[2], sample,     &EUSCI_B0_SPI->TXBUF, false);
+            set_byte_task(t[3], &_one,      &P5->OUT,             true, last);
+
+            // Start with silence
+            _samples[half][i] = 8192;
+        }
+    }
+
+    dma_msp432 & dma = dma_msp432::inst();
+    dma.ctrl_data[0].DST_DATA_END_PTR = &dma.ctrl_data[8].unused;
+    dma.ctrl_data[0].CTRL.CYCLE_CTRL  = DMA::CYCLE_PER_SCATTER_GATHER_PRI;
+    dma.ctrl_data[0].CTRL.N_MINUS_1   = AUDIO_HALF_BLOCK * 4 * 4 - 1;
+    dma.ctrl_data[0].CTRL.R_POWER     = DMA::ARB_AFTER_4;
+    dma.ctrl_data[0].CTRL.SRC_SIZE    = DMA::WORD;
+    dma.ctrl_data[0].CTRL.SRC_INC     = DMA::WORD;
+    dma.ctrl_data[0].CTRL.DST_SIZE    = DMA::WORD;
+    dma.ctrl_data[0].CTRL.DST_INC     = DMA::WORD;
+    _dma_ctrl0_backup = dma.ctrl_data[0].CTRL;
+
+    // Channel 0 is triggered by Timer_A0 CCR0 and raises DMA_INT1
+    DMA_Channel->CH_SRCCFG[0]  = 6;
+    DMA_Channel->INT1_SRCCFG   = DMA_INT1_SRCCFG_EN | 0;
+    DMA_Control->CFG           = DMA_CFG_MASTEN;
+    _block_output = this;
+    NVIC_EnableIRQ(DMA_INT1_IRQn);
+}
+
+uint32_t audio_output::sample_clock() const {
+    // Add the samples of the playing half which were already sent. Every
+    // sample takes four tasks of four words each, the primary control
+    // structure counts down the words left to copy. Repeat if the DMA
+    // interrupt switched the half in between.
+    uint32_t clock, played;
+    do {
+        clock  = _sample_clock;
+        played = AUDIO_HALF_BLOCK - (dma_msp432::inst().ctrl_data[0].CTRL.N_MINUS_1 + 1) / 16;
+        played = _half_fresh ? played : 0;
+    } while (clock != _sample_clock);
+    return clock + played;
+}
+
+void audio_output::start() {
+    // Half 0 holds silence and plays first
+    _dma_half = 0;
+    _half_state[0] = HALF_PLAYING;
+    _half_fresh = false;
+    arm_dma(0);
+    // Timer_A0 in up mode on SMCLK, CCR0 requests the DMA
+    TIMER_A0->CTL      = TIMER_A_CTL_TASSEL_2 | TIMER_A_CTL_CLR;
+    TIMER_A0->CCR[0]   = _timer_period - 1;
+    TIMER_A0->CCTL[0]  = 0;
+    TIMER_A0->CTL     |= TIMER_A_CTL_MC__UP;
+}
+
+void audio_output::stop() {
+    TIMER_A0->CTL &= ~TIMER_A_CTL_MC_MASK;
+    DMA_Control->ENACLR = BIT0;
+}
+
+void audio_output::arm_dma(uint8_t half) {
+    dma_msp432 & dma = dma_msp432::inst();
+    dma.ctrl_data[0].SRC_DATA_END_PTR = &_block_tasks[half][AUDIO_HALF_BLOCK * 4 - 1].unused;
+    dma.ctrl_data[0].CTRL = _dma_ctrl0_backup;
+    DMA_Control->ALTCLR = BIT0;
+    DMA_Control->ENASET = BIT0;
+}
+
+void audio_output::half_done() {
+    if (_half_fresh) _sample_clock += AUDIO_HALF_BLOCK;
+
+    // Only a half the renderer has finished is played next
+    uint8_t next  = _dma_half ^ 1;
+    bool    ready = _half_state[next] == HALF_READY;
+    if (ready) {
+        // Switch to the other half right away, the next timer
+        // trigger is one sample period away.
+        arm_dma(next);
+        _half_state[_dma_half] = HALF_FREE;
+        _half_state[next]      = HALF_PLAYING;
+        _dma_half    = next;
+        _current_run = 0;
+        _playing     = true;
+    } else {
+        // The renderer did not finish the other half in time. Leave it
+        // to the renderer and play silence in the finished half instead
+        // of repeating it. Silence does not advance the sample clock.
+        if (_half_fresh) {
+            for (uint16_t & v : _samples[_dma_half]) v = 8192;
+        }
+        arm_dma(_dma_half);
+        if (_playing) {
+            _stats.underruns += AUDIO_HALF_BLOCK;
+            _current_run     += AUDIO_HALF_BLOCK;
+            if (_current_run > _stats.longest_run) _stats.longest_run = _current_run;
+        }
+    }
+
+    // The FIFO level is the number of samples that were queued when the half finished
+    uint16_t level = ready ? AUDIO_HALF_BLOCK : 0;
+    if (_playing && level < _stats.fifo_low_water) _stats.fifo_low_water = level;
+    _half_fresh = ready;
+}
+
+extern "C" void DMA_INT1_IRQHandler(void) {
+    if (_block_output) _block_output->half_done();
+}
+
+#else
+
 audio_output::audio_output()
     : _audio_en (PORT_PIN(5,0)),
       _audio_cs (PORT_PIN(5,2)),
       _audio_spi(EUSCI_B0_SPI, _audio_cs),
       _pcm_fifo (PCM_FIFO_SIZE),
+      _sample_clock(0), _current_run(0), _playing(false),
       _zero(0), _one(BIT2)
 {
     // Configure BoostXL-audio objects
@@ -31,6 +193,7 @@ audio_output::audio_output()
     // the setRate() method by libmad.
     _pcm_timer.setCallback([this]() {
         if (_pcm_fifo.get(_pcm_value)) {
+            ++_sample_clock;
             // Trigger a DMA transfer ...
             dma_msp432::inst().ctrl_data[0].CTRL = _dma_ctrl0_backup;
             DMA_Control->ENASET    = BIT0;
@@ -40,6 +203,16 @@ audio_output::audio_output()
             // Send data via SPI ...
             // uint16_t sample = __builtin_bswap16(_pcm_value);
             // _audio_spi.spiTx((uint8_t *)&sample, 2);
+
+            // Track the FIFO low-water mark
+            uint16_t level = PCM_FIFO_SIZE - _pcm_fifo.available_put();
+            if (level < _stats.fifo_low_water) _stats.fifo_low_water = level;
+            _current_run = 0;
+            _playing     = true;
+        } else if (_playing) {
+            // Underrun, the sample is missing
+            ++_stats.underruns;
+            if (++_current_run > _stats.longest_run) _stats.longest_run = _current_run;
         }
     });
     _pcm_timer.setPeriod(1000, TIMER::PERIODIC);
@@ -104,3 +277,21 @@ audio_output::audio_output()
     DMA_Channel->CH_SRCCFG[0] = 0;
     DMA_Control->CFG          = DMA_CFG_MASTEN;
 }
+
+#endif // FM432_BLOCK_DMA
+
+underrun_stats audio_output::get_underrun_stats(bool reset) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    underrun_stats stats = _stats;
+    if (reset) {
+        _stats       = underrun_stats();
+        _current_run = 0;
+    }
+    __set_PRIMASK(primask);
+    return stats;
+}
+
+void audio_output::reset_underrun_stats() {
+    get_underrun_stats(true);
+}
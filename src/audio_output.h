@@ -17,6 +17,45 @@
 
 #define PCM_FIFO_SIZE 4096
 
+// Fill level the render loop keeps the PCM FIFO at. This is the output
+// latency in FIFO mode, it has to cover the sleep of the render loop.
+#ifndef PCM_FIFO_TARGET
+#define PCM_FIFO_TARGET 1024
+#endif
+static_assert(PCM_FIFO_TARGET <= PCM_FIFO_SIZE, "The fill target has to fit into the FIFO");
+
+// Block DMA output mode. Instead of one timer interrupt per sample
+// Timer_A0 paces the DMA, which clocks a whole half of a double
+// buffer out to the DAC. The CPU is only interrupted once per half.
+#ifndef FM432_BLOCK_DMA
+#define FM432_BLOCK_DMA 0
+#endif
+
+// Samples per half of the double buffer. One DMA run is limited to
+// 1024 words, i.e. 256 tasks of 4 words, which limits this to 64.
+#ifndef AUDIO_HALF_BLOCK
+#define AUDIO_HALF_BLOCK 64
+#endif
+static_assert(AUDIO_HALF_BLOCK <= 64, "A DMA run can not hold more than 64 samples");
+
+// Delay in samples from receiving a MIDI event to playing it. The render
+// loop applies the events at their exact sample if they arrive before the
+// block holding that sample is rendered. The renderer is at most two halves
+// ahead in block mode and PCM_FIFO_TARGET samples in FIFO mode, so the
+// latency is constant.
+#ifndef MIDI_EVENT_DELAY
+#if FM432_BLOCK_DMA
+#define MIDI_EVENT_DELAY (2 * AUDIO_HALF_BLOCK)
+#else
+#define MIDI_EVENT_DELAY PCM_FIFO_TARGET
+#endif
+#endif
+
+// Clock of Timer_A0 (SMCLK as configured by the startup code)
+#ifndef PCM_TIMER_CLOCK
+#define PCM_TIMER_CLOCK 12000000
+#endif
+
 #include <cstdint>
 #include "gpio_msp432.h"
 #include "spi_msp432.h"
@@ -24,6 +63,14 @@
 #include "dma_msp432.h"
 #include "FIFO.h"
 
+// Statistics about samples the PCM timer could not output
+struct underrun_stats
+{
+    uint32_t underruns      = 0;              // Number of missed samples in total
+    uint32_t longest_run    = 0;              // Longest run of consecutive missed samples
+    uint16_t fifo_low_water = PCM_FIFO_SIZE;  // Lowest FIFO fill level seen after a sample was output
+};
+
 class audio_output
 {
 public:
@@ -34,6 +81,38 @@ public:
         _audio_en.gpioWrite(!v);
     }
 
+#if FM432_BLOCK_DMA
+    void start();
+    void stop();
+
+    inline void setRate(uint32_t kHz) {
+        _timer_period = PCM_TIMER_CLOCK / kHz;
+    }
+
+    // Claims the half of the double buffer which can be filled with
+    // AUDIO_HALF_BLOCK samples, or returns nullptr if it is not free.
+    // Every half is owned by one side at a time: the CPU moves it from
+    // free to filling to ready, the DMA interrupt from ready to playing
+    // and back to free. The interrupt never switches to a half that is
+    // not ready, so a claimed half is never played while it is filled.
+    inline uint16_t * get_block() {
+        uint8_t half = _dma_half ^ 1;
+        if (_half_state[half] != HALF_FREE) return nullptr;
+        _half_state[half] = HALF_FILLING;
+        _fill_half = half;
+        return _samples[half];
+    }
+    // Hands the block claimed by get_block() to the DMA. Returns false
+    // if no block was claimed.
+    inline bool put_block() {
+        if (_half_state[_fill_half] != HALF_FILLING) return false;
+        _half_state[_fill_half] = HALF_READY;
+        return true;
+    }
+
+    // Called by the DMA interrupt when a half has been played
+    void half_done();
+#else
     inline void start() { _pcm_timer.start(); }
     inline void stop()  { _pcm_timer.stop();  }
 
@@ -42,7 +121,27 @@ public:
     }
 
     inline int  fifo_available_put() { return _pcm_fifo.available_put(); }
+    inline int  fifo_level() { return PCM_FIFO_SIZE - _pcm_fifo.available_put(); }
     inline void fifo_put(uint16_t v) { _pcm_fifo.put(v); }
+#endif
+
+    // Underruns are only counted after the first sample was output,
+    // so filling the FIFO after start() does not count as underrun.
+    // In block mode underruns are counted in whole halves.
+    // The output interrupt updates the statistics, so they are copied
+    // and reset with the interrupts masked. Passing reset = true takes
+    // the snapshot and resets in one step, so no underrun is lost.
+    underrun_stats get_underrun_stats(bool reset = false);
+    void reset_underrun_stats();
+
+    // Number of rendered samples played since start(). Underruns do not
+    // count, so the sample put at position n is played at clock n.
+    // Used to timestamp MIDI events.
+#if FM432_BLOCK_DMA
+    uint32_t sample_clock() const;
+#else
+    inline uint32_t sample_clock() const { return _sample_clock; }
+#endif
 
 private:
     // BoostXL-Audio Objects
@@ -50,15 +149,39 @@ private:
     gpio_msp432_pin _audio_cs;
     spi_msp432      _audio_spi;
 
+#if FM432_BLOCK_DMA
+    // Arms the DMA channel with the task list of one half
+    void arm_dma(uint8_t half);
+
+    // Double buffer and the DMA task lists for both halves
+    uint16_t          _samples[2][AUDIO_HALF_BLOCK];
+    DMA::CH_CTRL_DATA _block_tasks[2][AUDIO_HALF_BLOCK * 4];
+    enum half_state : uint8_t { HALF_FREE, HALF_FILLING, HALF_READY, HALF_PLAYING };
+    volatile half_state _half_state[2];
+    volatile uint8_t  _dma_half;
+    volatile bool     _half_fresh;  // The playing half holds rendered samples
+    uint8_t           _fill_half;
+    uint16_t          _timer_period;
+#else
     // The PCM output timer
     timer_msp432 _pcm_timer;
 
     // PCM FIFO buffer
     FIFO  <uint16_t> _pcm_fifo;
     uint16_t _pcm_value;
+#endif
+
+    volatile uint32_t _sample_clock;
+
+    // Underrun statistics
+    underrun_stats _stats;
+    uint32_t       _current_run;
+    bool           _playing;
 
     // DMA stuff
+#if !FM432_BLOCK_DMA
     DMA::CH_CTRL_DATA _tasks[4];
+#endif
     uint32_t _dma_ctrl0_backup;
     uint8_t  _zero;
     uint8_t  _one;
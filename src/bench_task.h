@@ -0,0 +1,52 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BENCH_TASK_H_
+#define BENCH_TASK_H_
+
+#include "uart_msp432.h"
+#include "posix_io.h"
+#include "task.h"
+
+#include "fm_bench.h"
+
+/**
+ * \brief Task running the benchmarks on the board.
+ *
+ * Used instead of main_task if the firmware is built with FM432_BENCHMARK.
+ * The results are printed in cycles to the backchannel UART.
+ */
+class bench_task : public task
+{
+public:
+    bench_task() : task("Bench", 6000) {
+
+    }
+
+    void run() override {
+        uart_msp432 uart;
+        posix_io::inst.register_stdout(uart);
+
+        while(true) {
+            runBenchmarks();
+            task::sleep(5000);
+        }
+    }
+};
+
+#endif /* BENCH_TASK_H_ */
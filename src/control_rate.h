@@ -0,0 +1,146 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CONTROL_RATE_H_
+#define CONTROL_RATE_H_
+
+#include "fm_defines.h"
+#include <cmath>
+#include <cstddef>
+
+/*\file control_rate.h
+ * \brief Control rate signals which are ramped at audio rate.
+ *
+ * Control signals (envelopes, parameter changes, modulators) are evaluated once
+ * every CONTROL_PERIOD samples at a control point. In between they are linearly
+ * ramped towards the value of the next control point, which costs a single addition
+ * per sample and avoids the steps of a held value.
+ *
+ * A voice counts down the samples to its next control point, evaluates its control
+ * signals there with rampTo() and calls advance() for every rendered sample.
+ *
+ * Parameters set by the user (SmoothedParam) are smoothed at block rate instead and
+ * held within a block, so they change in steps of RENDER_BLOCK_SIZE samples.
+ */
+
+/**
+ * \brief Linear ramp of a control signal over one control period.
+ */
+struct ControlRamp{
+private:
+    float value = 0.f; /**< Value at the current sample. */
+    float target = 0.f; /**< Value at the next control point. */
+    float step = 0.f; /**< Increment per sample. */
+public:
+    /**
+     * \brief Starts a ramp from the last target to a new one.
+     *
+     * Must be called at a control point. The value is set to the last target,
+     * so rounding errors of the ramp do not add up.
+     *
+     * \param[in] next The value at the next control point.
+     */
+    inline void rampTo(float next){
+        value = target;
+        target = next;
+        step = (next - value) * (1.f/CONTROL_PERIOD);
+    }
+
+    /**
+     * \brief Sets the value immediately without a ramp.
+     */
+    inline void jumpTo(float val){
+        value = val;
+        target = val;
+        step = 0.f;
+    }
+
+    /**
+     * \brief Advances the ramp by one sample.
+     */
+    inline void advance(){value += step;}
+
+    /**
+     * \brief Advances the ramp by n samples at once.
+     */
+    inline void advance(size_t n){value += step * n;}
+
+    inline float get() const {return value;}
+
+    inline float getTarget() const {return target;}
+};
+
+/**
+ * \brief Parameter which follows its target smoothly.
+ *
+ * Setting the parameter only changes the target. The value moves towards it with a
+ * one pole lowpass that is updated once per render block, which costs a single
+ * multiply-add per parameter and block. The value snaps onto the target when it is
+ * closer than 1e-5, so zero stays exactly zero.
+ */
+struct SmoothedParam{
+private:
+    float value = 0.f; /**< The smoothed value. */
+    float target = 0.f; /**< The value set last. */
+public:
+    /**
+     * \brief Sets a new target, the value follows with the next updates.
+     */
+    inline void set(float val){target = val;}
+
+    /**
+     * \brief Sets the value and the target without smoothing.
+     */
+    inline void jumpTo(float val){
+        value = val;
+        target = val;
+    }
+
+    /**
+     * \brief Moves the value one block closer to the target.
+     *
+     * \param[in] coef The smoothing coefficient of the block, see smoothingCoef().
+     *
+     * \return The new value.
+     */
+    inline float update(float coef){
+        value += (target - value) * coef;
+        value = (fabsf(target - value) < 1e-5f) ? target : value;
+        return value;
+    }
+
+    inline float get() const {return value;}
+
+    inline float getTarget() const {return target;}
+};
+
+/**
+ * \brief Calculates the smoothing coefficient of a block.
+ *
+ * Linear approximation of 1 - exp(-t/PARAM_SMOOTHING_TIME), which is close enough
+ * for blocks much shorter than the time constant and avoids the exponential per block.
+ *
+ * \param[in] n The number of samples in the block.
+ * \param[in] sampleDelta The time increment per sample in ms.
+ */
+inline float smoothingCoef(size_t n, float sampleDelta){
+    const float coef = n * sampleDelta * (1.f/PARAM_SMOOTHING_TIME);
+    return coef < 1.f ? coef : 1.f;
+}
+
+#endif /* CONTROL_RATE_H_ */
@@ -0,0 +1,73 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CYCLE_COUNTER_H_
+#define CYCLE_COUNTER_H_
+
+/*\file cycle_counter.h
+ * \brief Timestamps for measuring the cost of code.
+ *
+ * On the MSP432 the timestamps are CPU cycles from the DWT cycle counter.
+ * On the host they are nanoseconds from the steady clock.
+ * Differences of timestamps are always computed with unsigned arithmetic,
+ * so a wrap of the 32 bit cycle counter (every 89s at 48MHz) does not matter
+ * for shorter measurements.
+ */
+
+#include <cstdint>
+
+#if defined(__MSP432P401R__)
+
+#include "msp432.h"
+
+typedef uint32_t timestamp_t;
+
+#define TIMESTAMP_UNIT "cycles"
+
+/**
+ * \brief Starts the DWT cycle counter.
+ */
+inline void enableCycleCounter(){
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+inline timestamp_t readTimestamp(){
+    return DWT->CYCCNT;
+}
+
+#else
+
+#include <chrono>
+
+typedef uint64_t timestamp_t;
+
+#define TIMESTAMP_UNIT "ns"
+
+inline void enableCycleCounter(){
+}
+
+inline timestamp_t readTimestamp(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif
+
+#endif /* CYCLE_COUNTER_H_ */
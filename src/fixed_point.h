@@ -0,0 +1,115 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef FIXED_POINT_H_
+#define FIXED_POINT_H_
+
+/*\file fixed_point.h
+ * \brief Fixed point helpers used by the fixed point engine.
+ *
+ * On the MSP432 the helpers map to the saturating (SSAT, QADD) and multiply-accumulate (SMLAWB)
+ * instructions of the Cortex-M4 DSP extension. Everywhere else a portable
+ * implementation with identical results is used.
+ *
+ * Headroom: the phase shift sums wrap around on purpose, since only their value
+ * modulo one cycle matters. The output sums are Q15 in an int32, so they have
+ * 16 bits of headroom and saturate instead of wrapping if that is exceeded.
+ */
+
+#include <cstdint>
+
+#if defined(__MSP432P401R__) && defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+#include "msp432.h"
+#define FM_USE_DSP_INSTRUCTIONS 1
+#else
+#define FM_USE_DSP_INSTRUCTIONS 0
+#endif
+
+typedef int16_t q15_t; /**< Signed fixed point value with 15 fractional bits. */
+
+/**
+ * \brief Signed multiply accumulate word by bottom halfword.
+ *
+ * Computes acc + ((a * b) >> 16) with b being the lower 16 bits of the argument.
+ * The intermediate product is 48 bits wide, so nothing is lost before the shift.
+ * The addition wraps around like SMLAWB does (it only sets the Q flag). This is
+ * wanted for the phase shifts, which are taken modulo one cycle.
+ * Maps to SMLAWB.
+ */
+inline int32_t smlawb(int32_t a, q15_t b, int32_t acc){
+#if FM_USE_DSP_INSTRUCTIONS
+    int32_t result;
+    __ASM ("smlawb %0, %1, %2, %3" : "=r" (result) : "r" (a), "r" ((int32_t)b), "r" (acc));
+    return result;
+#else
+    //Add unsigned, signed overflow is undefined
+    return (int32_t)((uint32_t)acc + (uint32_t)(int32_t)(((int64_t)a * b) >> 16));
+#endif
+}
+
+/**
+ * \brief Saturating version of smlawb().
+ *
+ * Computes acc + ((a * b) >> 16) and saturates the sum to the int32 range.
+ * Used for the output sums. Maps to SMULWB and QADD.
+ */
+inline int32_t qmlawb(int32_t a, q15_t b, int32_t acc){
+#if FM_USE_DSP_INSTRUCTIONS
+    int32_t product;
+    __ASM ("smulwb %0, %1, %2" : "=r" (product) : "r" (a), "r" ((int32_t)b));
+    return __QADD(acc, product);
+#else
+    const int64_t sum = (int64_t)acc + (((int64_t)a * b) >> 16);
+    return (int32_t)(sum > INT32_MAX ? INT32_MAX : (sum < INT32_MIN ? INT32_MIN : sum));
+#endif
+}
+
+/**
+ * \brief Saturates a value into the Q15 range. Maps to SSAT.
+ */
+inline q15_t ssat16(int32_t val){
+#if FM_USE_DSP_INSTRUCTIONS
+    return (q15_t)__SSAT(val, 16);
+#else
+    return (q15_t)(val > INT16_MAX ? INT16_MAX : (val < INT16_MIN ? INT16_MIN : val));
+#endif
+}
+
+/**
+ * \brief Converts a float in [-1, 1] into Q15. Values outside are saturated.
+ */
+inline q15_t float_to_q15(float val){
+    return ssat16((int32_t)(val * 32768.f));
+}
+
+inline float q15_to_float(int32_t val){
+    return val * (1.f/32768.f);
+}
+
+/**
+ * \brief Converts a phase in cycles into a 32 bit phase accumulator value.
+ *
+ * Only the fractional part of the phase is kept. The argument must be positive.
+ */
+inline uint32_t float_to_phase(float cycles){
+    cycles -= (int32_t)cycles;
+    //Shift afterwards, as 2^32 does not fit into the conversion
+    return (uint32_t)(cycles * 2147483648.f) << 1;
+}
+
+#endif /* FIXED_POINT_H_ */
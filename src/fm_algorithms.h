@@ -0,0 +1,201 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef FM_ALGORITHMS_H_
+#define FM_ALGORITHMS_H_
+
+/*\file fm_algorithms.h
+ * \brief Fixed operator topologies (algorithms) known at compile time.
+ *
+ * An algorithm is a type describing which operator modulates which and
+ * which operators are carriers. The floating point voice engine is instantiated
+ * for every algorithm, so the compiler can unroll the whole operator graph and
+ * drop the unused edges. The fixed point engine walks a ModSchedule instead,
+ * which FMSynth compiles from fmAlgorithmEdges() and fmAlgorithmCarriers() once
+ * per algorithm or routing change. The modulation depths still come from the
+ * modulation matrix, edges which are not part of the algorithm are ignored.
+ *
+ * Like the modulation matrix the graph is evaluated from the last to the
+ * first operator, so a modulator needs a higher index than its carrier
+ * (self feedback excluded).
+ *
+ * FM_ALGO_FREE follows the non zero entries of the modulation matrix
+ * (see ModSchedule) and is used for free form routing.
+ */
+
+#include "fm_defines.h"
+#include <cstdint>
+
+static_assert(N_OSC * N_OSC <= 64, "The edge masks only have 64 bits");
+
+/**
+ * \brief Bit of the edge modulator -> carrier in an edge mask.
+ *
+ * The bit index is the same as the index in the modulation matrix.
+ */
+constexpr uint64_t fmEdge(uint8_t carrier, uint8_t modulator){
+    return 1ull << (carrier * N_OSC + modulator);
+}
+
+/**
+ * \brief Bit of an operator in a carrier mask.
+ */
+constexpr uint32_t fmCarrier(uint8_t osc){
+    return 1u << osc;
+}
+
+/**
+ * \brief Mask of all edges between the first n operators.
+ */
+constexpr uint64_t fmOperatorEdges(uint8_t n){
+    uint64_t edges = 0;
+    for(uint8_t i = 0; i < n; ++i){
+        for(uint8_t j = 0; j < n; ++j){
+            edges |= fmEdge(i, j);
+        }
+    }
+    return edges;
+}
+
+/**
+ * \brief Mask of the first n operators.
+ */
+constexpr uint32_t fmOperatorCarriers(uint8_t n){
+    return (n >= 32) ? ~0u : (1u << n) - 1;
+}
+
+/**
+ * \brief Mask of the operators taking part in the given edges and carriers.
+ */
+constexpr uint32_t fmUsedOperators(uint64_t edges, uint32_t carriers){
+    uint32_t ops = carriers;
+    for(uint8_t i = 0; i < N_OSC; ++i){
+        for(uint8_t j = 0; j < N_OSC; ++j){
+            if(edges & fmEdge(i, j)){
+                ops |= fmCarrier(i) | fmCarrier(j);
+            }
+        }
+    }
+    return ops & fmOperatorCarriers(N_OSC);
+}
+
+/**
+ * \brief A fixed operator topology.
+ *
+ * \tparam Edges Mask of the modulation edges, see fmEdge().
+ * \tparam Carriers Mask of the operators sent to the output, see fmCarrier().
+ */
+template<uint64_t Edges, uint32_t Carriers, bool Free=false>
+struct FMAlgorithm{
+    static constexpr uint64_t edges = Edges;
+    static constexpr uint32_t carriers = Carriers;
+    static constexpr uint32_t operators = fmUsedOperators(Edges, Carriers); /**< Operators which have to be evaluated. */
+    static constexpr bool isFree = Free; /**< If true the edges come from the compiled modulation matrix (ModSchedule). */
+
+    static constexpr bool hasEdge(uint8_t carrier, uint8_t modulator){
+        return (edges & fmEdge(carrier, modulator)) != 0;
+    }
+
+    static constexpr bool isCarrier(uint8_t osc){
+        return (carriers & fmCarrier(osc)) != 0;
+    }
+};
+
+/**
+ * \brief Ids of the available algorithms.
+ */
+enum FMAlgorithmId : uint8_t {
+    FM_ALGO_FREE = 0,    /**< Free routing through the whole modulation matrix. */
+    FM_ALGO_STACK,       /**< 1 -> 0, 0 is the carrier. */
+    FM_ALGO_STACK_FB,    /**< 1 -> 0 with feedback on 1, 0 is the carrier. */
+    FM_ALGO_STACK_MIX,   /**< 1 -> 0, 0 and 1 are carriers. */
+    FM_ALGO_PARALLEL,    /**< No modulation, 0 and 1 are carriers. */
+#if N_OSC >= 4
+    FM_ALGO_STACK4,      /**< 3 -> 2 -> 1 -> 0, 0 is the carrier. */
+    FM_ALGO_TWO_STACKS,  /**< 1 -> 0 and 3 -> 2, 0 and 2 are carriers. */
+    FM_ALGO_THREE_TO_ONE,/**< 1, 2 and 3 -> 0, 0 is the carrier. */
+#endif
+#if N_OSC >= 6
+    FM_ALGO_STACK6,      /**< 5 -> 4 -> 3 -> 2 -> 1 -> 0, 0 is the carrier. */
+    FM_ALGO_THREE_STACKS,/**< 1 -> 0, 3 -> 2 and 5 -> 4 with feedback on 5, 0, 2 and 4 are carriers. */
+#endif
+    FM_N_ALGORITHMS
+};
+
+typedef FMAlgorithm<~0ull, ~0u, true> FMAlgoFree;
+typedef FMAlgorithm<fmEdge(0, 1), fmCarrier(0)> FMAlgoStack;
+typedef FMAlgorithm<fmEdge(0, 1) | fmEdge(1, 1), fmCarrier(0)> FMAlgoStackFB;
+typedef FMAlgorithm<fmEdge(0, 1), fmCarrier(0) | fmCarrier(1)> FMAlgoStackMix;
+typedef FMAlgorithm<0, fmCarrier(0) | fmCarrier(1)> FMAlgoParallel;
+#if N_OSC >= 4
+typedef FMAlgorithm<fmEdge(0, 1) | fmEdge(1, 2) | fmEdge(2, 3), fmCarrier(0)> FMAlgoStack4;
+typedef FMAlgorithm<fmEdge(0, 1) | fmEdge(2, 3), fmCarrier(0) | fmCarrier(2)> FMAlgoTwoStacks;
+typedef FMAlgorithm<fmEdge(0, 1) | fmEdge(0, 2) | fmEdge(0, 3), fmCarrier(0)> FMAlgoThreeToOne;
+#endif
+#if N_OSC >= 6
+typedef FMAlgorithm<fmEdge(0, 1) | fmEdge(1, 2) | fmEdge(2, 3) | fmEdge(3, 4) | fmEdge(4, 5),
+                    fmCarrier(0)> FMAlgoStack6;
+typedef FMAlgorithm<fmEdge(0, 1) | fmEdge(2, 3) | fmEdge(4, 5) | fmEdge(5, 5),
+                    fmCarrier(0) | fmCarrier(2) | fmCarrier(4)> FMAlgoThreeStacks;
+#endif
+
+/**
+ * \brief Calls fn with an instance of the algorithm type selected by id.
+ *
+ * This is the only place mapping the run time ids to the types. Unknown ids
+ * use the free routing.
+ */
+template<typename Fn>
+inline void dispatchAlgorithm(uint8_t id, Fn&& fn){
+    switch(id){
+    case FM_ALGO_STACK:        fn(FMAlgoStack{});      break;
+    case FM_ALGO_STACK_FB:     fn(FMAlgoStackFB{});    break;
+    case FM_ALGO_STACK_MIX:    fn(FMAlgoStackMix{});   break;
+    case FM_ALGO_PARALLEL:     fn(FMAlgoParallel{});   break;
+#if N_OSC >= 4
+    case FM_ALGO_STACK4:       fn(FMAlgoStack4{});     break;
+    case FM_ALGO_TWO_STACKS:   fn(FMAlgoTwoStacks{});  break;
+    case FM_ALGO_THREE_TO_ONE: fn(FMAlgoThreeToOne{}); break;
+#endif
+#if N_OSC >= 6
+    case FM_ALGO_STACK6:       fn(FMAlgoStack6{});     break;
+    case FM_ALGO_THREE_STACKS: fn(FMAlgoThreeStacks{}); break;
+#endif
+    default:                   fn(FMAlgoFree{});       break;
+    }
+}
+
+/**
+ * \brief Returns the edge mask of an algorithm at run time.
+ */
+inline uint64_t fmAlgorithmEdges(uint8_t id){
+    uint64_t edges = 0;
+    dispatchAlgorithm(id, [&edges](auto algo){ edges = decltype(algo)::edges; });
+    return edges;
+}
+
+/**
+ * \brief Returns the carrier mask of an algorithm at run time.
+ */
+inline uint32_t fmAlgorithmCarriers(uint8_t id){
+    uint32_t carriers = 0;
+    dispatchAlgorithm(id, [&carriers](auto algo){ carriers = decltype(algo)::carriers; });
+    return carriers;
+}
+
+#endif /* FM_ALGORITHMS_H_ */
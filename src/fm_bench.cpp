@@ -0,0 +1,414 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "fm_bench.h"
+#include "cycle_counter.h"
+#include "FMOscillator.h"
+#include "FMOscillatorQ15.h"
+#include "FMSynth.h"
+#include "MidiParser.h"
+#include "SynthController.h"
+#include "oscillators.h"
+#include "wavetables.h"
+#include <cstdio>
+
+static volatile float sink; /**< Keeps the compiler from removing the benchmarked code. */
+
+/**
+ * \brief Measures the cost per sample of fn, which has to process BENCH_SAMPLES samples.
+ *
+ * \return The fastest of BENCH_REPEATS runs in timestamp units per sample.
+ */
+template<typename Fn>
+static float measure(Fn fn)
+{
+    float best = 1e30f;
+    for(uint8_t rep = 0; rep < BENCH_REPEATS; ++rep){
+        const timestamp_t start = readTimestamp();
+        fn();
+        const timestamp_t end = readTimestamp();
+        const float perSample = static_cast<float>(end - start) / BENCH_SAMPLES;
+        best = perSample < best ? perSample : best;
+    }
+    return best;
+}
+
+/**
+ * \brief Prints one result line.
+ *
+ * The value is printed with two decimals without using float formatting,
+ * which is not available with newlib nano.
+ */
+static void report(const char* name, uint8_t voices, float value)
+{
+    const uint32_t fixed = static_cast<uint32_t>(value * 100.f + .5f);
+    printf("%s,%u,%lu.%02lu,%s\n", name, voices,
+           static_cast<unsigned long>(fixed / 100), static_cast<unsigned long>(fixed % 100), TIMESTAMP_UNIT);
+}
+
+/**
+ * \brief Phases of consecutive samples at 246 Hz, precomputed so the timed loop does not wait for the phase update.
+ *
+ * The band limited oscillators correct 2.5% of the samples at this increment.
+ */
+static constexpr float benchDt = 0.0123f;
+static float benchPhases[BENCH_PHASES];
+static float oscOverhead = 0.f; /**< Result of osc_empty, subtracted from the other oscillators. */
+
+static void benchOscillator(const char* name, OSCParam::osc_fn fn)
+{
+    //Call through a pointer like the voices do
+    volatile OSCParam::osc_fn vfn = fn;
+    const OSCParam::osc_fn call = vfn;
+    const float result = measure([call](){
+        //Independent calls and accumulators, so only the throughput of the oscillator is measured
+        float acc[4] = {0.f};
+        for(uint32_t i = 0; i < BENCH_SAMPLES; i += 4){
+            const float* ph = benchPhases + (i & (BENCH_PHASES - 1));
+            acc[0] += call(ph[0], benchDt);
+            acc[1] += call(ph[1], benchDt);
+            acc[2] += call(ph[2], benchDt);
+            acc[3] += call(ph[3], benchDt);
+        }
+        sink = acc[0] + acc[1] + acc[2] + acc[3];
+    });
+    if(fn == &empty_osc_fn){
+        oscOverhead = result;
+        report(name, 0, result);
+    }else{
+        report(name, 0, result > oscOverhead ? result - oscOverhead : 0.f);
+    }
+}
+
+/**
+ * \brief Measures one envelope in the decay, which is the segment a held note spends the most time in.
+ */
+static void benchEnvelope()
+{
+    const float delta = 1000.f/SAMPLE_RATE;
+    ADSRParam param;
+    param.setAttack(1e-3f);
+    param.setDecay(800.f);
+    param.setSustain(.7f);
+    ADSREnvelope env;
+    env.start();
+    report("envelope_step", 0, measure([&param, &env, delta](){
+        float acc = 0.f;
+        for(uint32_t i = 0; i < BENCH_SAMPLES; i += RENDER_BLOCK_SIZE){
+            env.prepare(param, delta);
+            for(uint32_t s = 0; s < RENDER_BLOCK_SIZE; ++s){
+                env.step(param, delta);
+                acc += env.getLevel();
+            }
+        }
+        sink = acc;
+    }));
+}
+
+/**
+ * \brief Stand alone patch for the voice benchmarks. Same as the default patch.
+ */
+struct BenchPatch{
+    float modmat[N_OSC*N_OSC] = {0.f};
+    float vols[N_OSC] = {0.f};
+    float pans[N_OSC] = {0.f};
+    OSCParam params[N_OSC];
+    ModSchedule schedule;
+
+    BenchPatch(){
+        modmat[0*N_OSC + 1] = 2.f;
+        vols[0] = 1.f;
+        params[0].oscillator = &sine;
+        params[0].adsr.setAttack(20.f);
+        params[0].adsr.setDecay(800.f);
+        params[0].adsr.setRelease(20.f);
+        params[1].ratio = 2.f;
+        params[1].oscillator = &triangle;
+        params[1].adsr.setAttack(10.f);
+        params[1].adsr.setDecay(700.f);
+        params[1].adsr.setSustain(.7f);
+        schedule.compile(modmat, vols);
+    }
+};
+
+static void benchVoices()
+{
+    const float delta = 1000.f/SAMPLE_RATE;
+    BenchPatch patch;
+    float block[RENDER_BLOCK_SIZE];
+
+    FMOscillator osc(patch.modmat, patch.params, patch.vols, patch.pans, nullptr, &patch.schedule);
+    osc.init(220.f);
+    report("voice_generate_sample", 1, measure([&osc](){
+        float acc = 0.f;
+        for(uint32_t i = 0; i < BENCH_SAMPLES; ++i){
+            acc += osc.generateSample(false);
+        }
+        sink = acc;
+    }));
+    report("voice_increment_phase", 1, measure([&osc, delta](){
+        for(uint32_t i = 0; i < BENCH_SAMPLES; ++i){
+            osc.incrementPhase(delta);
+        }
+    }));
+    report("voice_render_block", 1, measure([&osc, &block, delta](){
+        for(uint32_t i = 0; i < BENCH_SAMPLES; i += RENDER_BLOCK_SIZE){
+            osc.renderBlock(block, RENDER_BLOCK_SIZE, delta, false);
+        }
+        sink = block[0];
+    }));
+
+    //Same patch with the topology fixed at compile time
+    const uint8_t algorithm = FM_ALGO_STACK;
+    FMOscillator oscAlgo(patch.modmat, patch.params, patch.vols, patch.pans, &algorithm);
+    oscAlgo.init(220.f);
+    report("voice_render_block_algo", 1, measure([&oscAlgo, &block, delta](){
+        for(uint32_t i = 0; i < BENCH_SAMPLES; i += RENDER_BLOCK_SIZE){
+            oscAlgo.renderBlock(block, RENDER_BLOCK_SIZE, delta, false);
+        }
+        sink = block[0];
+    }));
+
+    FMOscillatorQ15 oscQ15(patch.modmat, patch.params, patch.vols, patch.pans, nullptr, &patch.schedule);
+    oscQ15.init(220.f);
+    report("voice_q15_render_block", 1, measure([&oscQ15, &block, delta](){
+        for(uint32_t i = 0; i < BENCH_SAMPLES; i += RENDER_BLOCK_SIZE){
+            oscQ15.renderBlock(block, RENDER_BLOCK_SIZE, delta, false);
+        }
+        sink = block[0];
+    }));
+}
+
+/**
+ * \brief Measures voices with a stack of n sine operators, n-1 -> ... -> 1 -> 0.
+ *
+ * Only the operators of the patch are used, so the cost should grow with
+ * the number of operators and not with N_OSC.
+ */
+static void benchOperators()
+{
+    const float delta = 1000.f/SAMPLE_RATE;
+    float block[RENDER_BLOCK_SIZE];
+    char name[32];
+
+    for(uint8_t ops = 2; ops <= N_OSC; ops += 2){
+        BenchPatch patch;
+        for(uint8_t i = 0; i < N_OSC*N_OSC; ++i){
+            patch.modmat[i] = 0.f;
+        }
+        for(uint8_t i = 0; i + 1 < ops; ++i){
+            patch.modmat[i*N_OSC + i+1] = 1.f;
+            patch.params[i+1].oscillator = &sine;
+            patch.params[i+1].ratio = i + 2.f;
+        }
+        patch.schedule.compile(patch.modmat, patch.vols, fmOperatorEdges(ops), fmOperatorCarriers(ops));
+
+        FMOscillator osc(patch.modmat, patch.params, patch.vols, patch.pans, nullptr, &patch.schedule);
+        osc.init(220.f);
+        snprintf(name, sizeof(name), "voice_%uop_render_block", ops);
+        report(name, 1, measure([&osc, &block, delta](){
+            for(uint32_t i = 0; i < BENCH_SAMPLES; i += RENDER_BLOCK_SIZE){
+                osc.renderBlock(block, RENDER_BLOCK_SIZE, delta, false);
+            }
+            sink = block[0];
+        }));
+
+        FMOscillatorQ15 oscQ15(patch.modmat, patch.params, patch.vols, patch.pans, nullptr, &patch.schedule);
+        oscQ15.init(220.f);
+        snprintf(name, sizeof(name), "voice_q15_%uop_render_block", ops);
+        report(name, 1, measure([&oscQ15, &block, delta](){
+            for(uint32_t i = 0; i < BENCH_SAMPLES; i += RENDER_BLOCK_SIZE){
+                oscQ15.renderBlock(block, RENDER_BLOCK_SIZE, delta, false);
+            }
+            sink = block[0];
+        }));
+    }
+}
+
+static void benchSynth()
+{
+    const float delta = 1000.f/SAMPLE_RATE;
+    float block[RENDER_BLOCK_SIZE];
+
+    for(uint8_t voices = 1; voices <= MAX_POLYPHONY; ++voices){
+        FMSynth synth;
+        SynthController control(synth);
+        control.loadDefaultPatch();
+        for(uint8_t i = 0; i < voices; ++i){
+            synth.notePressedEvent(48 + 7*i, 100);
+        }
+
+        report("synth_get_sample", voices, measure([&synth, delta](){
+            float acc = 0.f;
+            for(uint32_t i = 0; i < BENCH_SAMPLES; ++i){
+                acc += synth.getSample(false);
+                synth.incrementPhases(delta);
+            }
+            sink = acc;
+        }));
+        report("synth_render_block", voices, measure([&synth, &block](){
+            for(uint32_t i = 0; i < BENCH_SAMPLES; i += RENDER_BLOCK_SIZE){
+                synth.renderBlock(block, RENDER_BLOCK_SIZE, false);
+            }
+            sink = block[0];
+        }));
+        //Same notes rendered oversampled, compare with synth_render_block to get the cost in voices
+        synth.setOversampling(2);
+        report("synth_render_block_os2", voices, measure([&synth, &block](){
+            for(uint32_t i = 0; i < BENCH_SAMPLES; i += RENDER_BLOCK_SIZE){
+                synth.renderBlock(block, RENDER_BLOCK_SIZE, false);
+            }
+            sink = block[0];
+        }));
+        synth.setOversampling(4);
+        report("synth_render_block_os4", voices, measure([&synth, &block](){
+            for(uint32_t i = 0; i < BENCH_SAMPLES; i += RENDER_BLOCK_SIZE){
+                synth.renderBlock(block, RENDER_BLOCK_SIZE, false);
+            }
+            sink = block[0];
+        }));
+    }
+}
+
+/**
+ * \brief Measures the decimation filters alone, per output sample.
+ */
+static void benchDecimator()
+{
+    float in[RENDER_BLOCK_SIZE];
+    float out[RENDER_BLOCK_SIZE];
+    for(size_t i = 0; i < RENDER_BLOCK_SIZE; ++i){
+        in[i] = (i & 1) ? .5f : -.25f;
+    }
+    HalfbandDecimator<HALFBAND_LONG_PAIRS> longFilter(halfbandLong);
+    HalfbandDecimator<HALFBAND_SHORT_PAIRS> shortFilter(halfbandShort);
+
+    report("decimate_2x", 0, measure([&longFilter, &in, &out](){
+        for(uint32_t i = 0; i < BENCH_SAMPLES; i += RENDER_BLOCK_SIZE/2){
+            longFilter.process(in, out, RENDER_BLOCK_SIZE/2);
+        }
+        sink = out[0];
+    }));
+    report("decimate_4x", 0, measure([&longFilter, &shortFilter, &in, &out](){
+        for(uint32_t i = 0; i < BENCH_SAMPLES; i += RENDER_BLOCK_SIZE/4){
+            shortFilter.process(in, out, RENDER_BLOCK_SIZE/2);
+            longFilter.process(out, out, RENDER_BLOCK_SIZE/4);
+        }
+        sink = out[0];
+    }));
+}
+
+/**
+ * \brief Sink counting the parsed events, the handlers are inlined into the parser.
+ */
+struct CountingSink{
+    uint32_t events = 0;
+    inline void noteOn(uint8_t note, uint8_t) {events += note;}
+    inline void noteOff(uint8_t note, uint8_t) {events += note;}
+    inline void controlChange(uint8_t, uint8_t val) {events += val;}
+    inline void controlChange14Bit(uint8_t, uint16_t val) {events += val;}
+    inline void pitchBend(uint16_t val) {events += val;}
+};
+
+/**
+ * \brief Fills buf with a dense MIDI stream of notes, CCs and pitch bends with running status.
+ */
+static void fillMidiStream(uint8_t* buf, size_t n)
+{
+    static const uint8_t pattern[] = {
+        0x90, 60, 100, 64, 100, 67, 100,  //Chord with running status
+        0xB0, 11, 40, 11, 41, 11, 42,     //CC sweep
+        0xE0, 0, 64, 10, 64,              //Pitch bend
+        0x80, 60, 0, 64, 0, 67, 0,        //Release the chord
+    };
+    for(size_t i = 0; i < n; ++i){
+        buf[i] = pattern[i % sizeof(pattern)];
+    }
+}
+
+/**
+ * \brief Measures the parser per byte with the std::function sink, an inlined sink and the bulk parsing.
+ */
+static void benchMidi()
+{
+    static uint8_t stream[BENCH_SAMPLES];
+    fillMidiStream(stream, BENCH_SAMPLES);
+
+    uint32_t events = 0;
+    FunctionSink functions;
+    functions.attachNoteOn([&events](uint8_t note, uint8_t){events += note;});
+    functions.attachNoteOff([&events](uint8_t note, uint8_t){events += note;});
+    functions.attachCCEvent7Bit([&events](uint8_t, uint8_t val){events += val;});
+    functions.attachPitchBendEvent([&events](uint16_t val){events += val;});
+    MidiParser<FunctionSink> functionParser(functions);
+    functionParser.setChannel(17);
+    report("midi_parse_function", 0, measure([&functionParser](){
+        for(uint32_t i = 0; i < BENCH_SAMPLES; ++i){
+            functionParser.consumeByte(stream[i]);
+        }
+    }));
+    sink = events;
+
+    CountingSink counter;
+    MidiParser<CountingSink> inlineParser(counter);
+    inlineParser.setChannel(17);
+    report("midi_parse_inline", 0, measure([&inlineParser](){
+        for(uint32_t i = 0; i < BENCH_SAMPLES; ++i){
+            inlineParser.consumeByte(stream[i]);
+        }
+    }));
+    report("midi_parse_bulk", 0, measure([&inlineParser](){
+        inlineParser.consumeByte(stream, BENCH_SAMPLES);
+    }));
+    sink = counter.events;
+}
+
+void runBenchmarks()
+{
+    enableCycleCounter();
+    printf("benchmark,voices,per_sample,unit\n");
+
+    float phase = 0.f;
+    for(float& ph : benchPhases){
+        ph = phase;
+        phase += benchDt;
+        phase -= static_cast<int32_t>(phase);
+    }
+    //Loop and call overhead, subtracted from the other oscillators
+    benchOscillator("osc_empty", &empty_osc_fn);
+    benchOscillator("osc_sine", &sine);
+    benchOscillator("osc_triangle", &triangle);
+    benchOscillator("osc_saw", &saw);
+    benchOscillator("osc_square", &square);
+    benchOscillator("osc_square25pwm", &square25pwm);
+    benchOscillator("osc_square10pwm", &square10pwm);
+    benchOscillator("osc_saw_blep", &saw_blep);
+    benchOscillator("osc_square_blep", &square_blep);
+    benchOscillator("osc_square25pwm_blep", &square25pwm_blep);
+    benchOscillator("osc_square10pwm_blep", &square10pwm_blep);
+    benchOscillator("osc_sine256", &sine256);
+    benchOscillator("osc_sine1024", &sine1024);
+    benchOscillator("osc_sine4096", &sine4096);
+
+    benchEnvelope();
+    benchVoices();
+    benchOperators();
+    benchSynth();
+    benchDecimator();
+    benchMidi();
+}
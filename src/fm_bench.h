@@ -0,0 +1,69 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef FM_BENCH_H_
+#define FM_BENCH_H_
+
+/*\file fm_bench.h
+ * \brief Microbenchmarks for the oscillators, voices and the synth.
+ *
+ * The same benchmarks run on the host (ns per sample) and on the
+ * MSP432 (cycles per sample, see cycle_counter.h).
+ * The results are printed as CSV lines to stdout:
+ *
+ *     benchmark,voices,per_sample,unit
+ *
+ * voices is 0 for benchmarks that do not depend on the polyphony.
+ * The oscillators are reported without the loop and call overhead measured by osc_empty.
+ * The MIDI parser benchmarks are per parsed byte instead of per sample.
+ */
+
+#include <cstdint>
+
+/*
+ * \brief Number of samples per measurement.
+ */
+#ifndef BENCH_SAMPLES
+#if defined(__MSP432P401R__)
+#define BENCH_SAMPLES 2048
+#else
+#define BENCH_SAMPLES 65536
+#endif
+#endif
+
+/*
+ * \brief Number of precomputed phases for the oscillator benchmarks, has to be a power of two.
+ */
+#ifndef BENCH_PHASES
+#define BENCH_PHASES 256
+#endif
+static_assert((BENCH_PHASES & (BENCH_PHASES - 1)) == 0 && BENCH_PHASES >= 4, "BENCH_PHASES must be a power of two");
+
+/*
+ * \brief Number of repetitions of each measurement. The fastest one is reported.
+ */
+#ifndef BENCH_REPEATS
+#define BENCH_REPEATS 5
+#endif
+
+/**
+ * \brief Runs all benchmarks and prints the results.
+ */
+void runBenchmarks();
+
+#endif /* FM_BENCH_H_ */
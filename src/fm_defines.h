@@ -25,13 +25,70 @@
 
 /*\brief How many oscillators should there be in total
  *
+ * This is the maximum, a patch can use less operators (FMSynth::setOperatorCount()).
+ * The per voice state is sized by it, the cost per sample only depends on the
+ * operators and modulation paths the patch uses.
  */
+#ifndef N_OSC
 #define N_OSC 2
+#endif
+static_assert(N_OSC >= 2 && N_OSC <= 8, "N_OSC must be between 2 and 8");
 
 /*
  * \brief Maximum amount of Voices playing at once.
  */
 #define MAX_POLYPHONY 4
+static_assert(MAX_POLYPHONY <= 32, "The free voices are kept in a 32 bit mask");
+
+/*
+ * \brief Length of the fade out of a stolen voice in samples.
+ *
+ * The new note starts after the fade, so this is also its added latency.
+ */
+#define VOICE_STEAL_FADE 32
+
+/*
+ * \brief Output sampling rate in Hz.
+ */
+#define SAMPLE_RATE 20000
+
+/*
+ * \brief Number of samples rendered in one block.
+ *
+ * Per block setup (voice lookup, phase increments, panning) is done once,
+ * so larger blocks mean less bookkeeping per sample.
+ */
+#define RENDER_BLOCK_SIZE 32
+
+/*
+ * \brief Number of samples in one control period.
+ *
+ * The envelopes and other control signals are evaluated once per control period
+ * and linearly ramped at audio rate in between, see control_rate.h.
+ */
+#ifndef CONTROL_PERIOD
+#define CONTROL_PERIOD 16
+#endif
+static_assert(CONTROL_PERIOD == 8 || CONTROL_PERIOD == 16 || CONTROL_PERIOD == 32 || CONTROL_PERIOD == 64,
+              "CONTROL_PERIOD must be 8, 16, 32 or 64");
+
+/*
+ * \brief Time constant of the parameter smoothing in ms.
+ *
+ * Modulation depths, output volumes, pannings and the global volume follow
+ * their new values with a one pole lowpass of this time constant.
+ */
+#define PARAM_SMOOTHING_TIME 10.f
+
+/*
+ * \brief Selects the voice engine.
+ *
+ * 0 uses the floating point engine (FMOscillator), 1 the fixed point
+ * engine (FMOscillatorQ15) which is built around the Cortex-M4 DSP instructions.
+ */
+#ifndef FM_FIXED_POINT
+#define FM_FIXED_POINT 0
+#endif
 
 
 inline float pan2vol(float pan, bool isLeftChannel){
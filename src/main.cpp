@@ -33,14 +33,29 @@
 #include <uart_msp432.h>
 #include <posix_io.h>
 
+// Run the benchmarks of fm_bench.h instead of the synth
+#ifndef FM432_BENCHMARK
+#define FM432_BENCHMARK 0
+#endif
+
+#if FM432_BENCHMARK
+#include "bench_task.h"
+#else
 #include "main_task.h"
+#endif
 
 int main(void)
 {
+#if FM432_BENCHMARK
+    // Run the benchmarks instead of the synth
+    bench_task Main;
+    Main.start(50, true);
+#else
     // Start Main task as privileged task, because
     // it has to initialize the DMA stuff...
     main_task Main;
     Main.start(50, true);
+#endif
 
     // Start the Task monitor
     //task_monitor monitor;
@@ -38,12 +38,14 @@
 #include "spi_msp432.h"
 #include "sd_spi_drv.h"
 #include "FMSynth.h"
+#include "SynthController.h"
 #include "audio_output.h"
-#include "oscillators.h"
+#include "render_stats.h"
 
 #include "task.h"
 
 #include "MidiParser.h"
+#include "MidiEventQueue.h"
 #include "MidiTask.h"
 
 class main_task : public task
@@ -58,125 +60,14 @@ public:
         audio_output audio_output;
         FMSynth synth;
 
-        synth.setMono(false);
-        //synth.setLegato(true);
-        synth.setMod(0, 1, 2.0f);
-        synth.setOutputVolume(0, 1.f);
-        OSCParam& mod1 = synth.getParam(0);
-        mod1.ratio = 1.f;
-        mod1.oscillator = &sine;
-        mod1.adsr.setAttack(20.f);
-        mod1.adsr.setSustain(1.f);
-        mod1.adsr.setDecay(800.f);
-        mod1.adsr.setRelease(20.f);
-
-        OSCParam& mod2 = synth.getParam(1);
-        mod2.ratio = 2.f;
-        mod2.oscillator = &triangle;
-        mod2.adsr.setAttack(10.f);
-        mod2.adsr.setDecay(700.f);
-        mod2.adsr.setSustain(0.7f);
-
-        //Increment per step in ms
-        constexpr float delta = (1000/20000.f);
-        //Volume
-        float vol = 1.f;
-
-        //Bitcrusher values
-        uint16_t bc_val = 1;
-        float ibc_val = 1.f;
-
-        MidiParser parser;
-        //Set up Callbacks
-        parser.attachNoteOn([&synth](uint8_t a, uint8_t b){
-            synth.notePressedEvent(a, b);
-        });
-
-        parser.attachNoteOff([&synth](uint8_t a, uint8_t b){
-            synth.noteReleasedEvent(a, b);
-        });
-
-        parser.attachCCEvent7Bit([&synth, &bc_val, &ibc_val, &vol, &mod1, &mod2](uint8_t id, uint8_t val){
-            // Modulation Parameters
-            if(id == 11){
-                synth.setMod(0, 0, val/127.f * 3.f);
-            }else if(id == 12){
-                synth.setMod(0, 1, .3f+val/127.f * 3.f);
-            }else if(id == 13){
-                synth.setMod(1, 0, val/127.f * 3.f);
-            }else if(id == 14){
-                synth.setMod(1, 1, val/127.f * 3.f);
-            }else if(id == 15){
-                //Output Parameters
-                synth.setOutputVolume(0, val/127.f);
-            }else if(id == 16){
-                synth.setOutputVolume(1, val/127.f);
-            }else if(id == 17){
-                //Vol
-                vol = val/64.f;
-            }else if(id == 18){
-                bc_val = 30*(uint16_t)val + 1;
-                ibc_val = 1.f/(float)bc_val;
-            }else if (id == 19) {
-                //OSC 0 Attack
-                mod1.adsr.setAttack(std::exp(val/100.f) * 7000.f - 7000.f);
-            }else if (id == 20) {
-                //OSC 0 Decay
-                mod1.adsr.setDecay(std::exp(val/100.f) * 7000.f - 7000.f);
-            }else if (id == 21) {
-                //OSC 0 Sustain
-                mod1.adsr.setSustain(val/127.f);
-            }else if (id == 22) {
-                //OSC 0 Release
-                mod1.adsr.setRelease(std::exp(val/100.f) * 7000.f - 7000.f);
-            }else if (id == 23) {
-                //OSC 1 Attack
-                mod2.adsr.setAttack(std::exp(val/100.f) * 7000.f - 7000.f);
-            }else if (id == 24) {
-                //OSC 1 Decay
-                mod2.adsr.setDecay(std::exp(val/100.f) * 7000.f - 7000.f);
-            }else if (id == 25) {
-                //OSC 1 Sustain
-                mod2.adsr.setSustain(val/127.f);
-            }else if (id == 26) {
-                //OSC 1 Release
-                mod2.adsr.setRelease(std::exp(val/100.f) * 7000.f - 7000.f);
-            }else if (id == 27) {
-                //OSC 0 Waveform
-                if(val < 32) {
-                    mod1.oscillator = &sine;
-                }else if (id < 64) {
-                    mod1.oscillator = &triangle;
-                }else if (id < 96) {
-                    mod1.oscillator = &saw;
-                }else {
-                    mod1.oscillator = &square;
-                }
-            }else if (id == 28) {
-                //OSC 1 Waveform
-                if(val < 32) {
-                    mod2.oscillator = &sine;
-                }else if (id < 64) {
-                    mod2.oscillator = &triangle;
-                }else if (id < 96) {
-                    mod2.oscillator = &saw;
-                }else {
-                    mod2.oscillator = &square;
-                }
-            }else if (id == 30) {
-                //OSC 0 Ratio
-                //2^((val-63)/16)
-                mod1.ratio = std::pow(2.f, (val -63.f)/16);
-            }else if (id == 31) {
-                //OSC 1 Ratio
-                mod2.ratio = std::pow(2.f, (val -63.f)/16);
-            }
-        });
+        SynthController control(synth);
+        control.loadDefaultPatch();
 
-        parser.attachPitchBendEvent([&synth](uint16_t val){
-           float b = (val/8192.f - 1.f)*1200.f;
-           synth.setDetune(b);
-        });
+        //The UART interrupt only parses, the render loop applies the events at their sample
+        MidiEventQueue midiQueue;
+        midiQueue.setClock([](void* out){return static_cast<class audio_output*>(out)->sample_clock() + MIDI_EVENT_DELAY;},
+                           &audio_output);
+        MidiParser<MidiEventQueue> parser(midiQueue);
 
         //Set up side buttons for channel switching
         gpio_msp432& gpios = gpio_msp432::inst;
@@ -197,27 +88,60 @@ public:
         gpios.gpioEnableIrq(PORT_PIN(1, 4));
 
         //Initialize Midi Task
-        MidiTask midiT(parser);
+        MidiTask<MidiEventQueue> midiT(parser);
 
         //Set up Audio output
-        audio_output.setRate(20000); //20kHz samplerate -> 10kHz max freq
+        audio_output.setRate(SAMPLE_RATE); //20kHz samplerate -> 10kHz max freq
+        synth.setSampleRate(SAMPLE_RATE);
         audio_output.enable_output(true);
 
 
         float premul = 6191;
+        float block[RENDER_BLOCK_SIZE];
+        uint32_t renderClock = 0; //Sample clock of the next rendered sample
+#if FM432_PROFILE
+        enableCycleCounter();
+#endif
         //Start output
         audio_output.start();
 
         while(true) {
-            while(audio_output.fifo_available_put() > 0){
-                float val = vol * synth.getSample(false);
-                val = clampSignal(val);
-                audio_output.fifo_put(8192 + bc_val * static_cast<int16_t>(val *premul * ibc_val));
-                synth.incrementPhases(delta);
+#if FM432_BLOCK_DMA
+            static_assert(AUDIO_HALF_BLOCK % RENDER_BLOCK_SIZE == 0, "Half buffer must hold whole render blocks");
+            while(uint16_t* out = audio_output.get_block()){
+                PROFILE_START(renderStart);
+                for(size_t i = 0; i < AUDIO_HALF_BLOCK; i += RENDER_BLOCK_SIZE){
+                    control.renderBlock(block, RENDER_BLOCK_SIZE, midiQueue, renderClock);
+                    renderClock += RENDER_BLOCK_SIZE;
+                    for(float val : block){
+                        *out++ = 8192 + control.toPCM(val, premul);
+                    }
+                }
+                audio_output.put_block();
+                PROFILE_END_N(renderStart, render, AUDIO_HALF_BLOCK);
+            }
+            PROFILE_START(cleanStart);
+            synth.cleanVoicePool(); //Clean up Voicepool, this improves performance.
+            PROFILE_END(cleanStart, cleanup);
+
+            task::sleep(1); //A half buffer only lasts a few ms.
+#else
+            //Keep the FIFO at the fill target, then the events are stamped ahead of the render position
+            while(audio_output.fifo_level() + RENDER_BLOCK_SIZE <= PCM_FIFO_TARGET){
+                PROFILE_START(renderStart);
+                control.renderBlock(block, RENDER_BLOCK_SIZE, midiQueue, renderClock);
+                renderClock += RENDER_BLOCK_SIZE;
+                for(float val : block){
+                    audio_output.fifo_put(8192 + control.toPCM(val, premul));
+                }
+                PROFILE_END_N(renderStart, render, RENDER_BLOCK_SIZE);
             }
+            PROFILE_START(cleanStart);
             synth.cleanVoicePool(); //Clean up Voicepool, this improves performance.
+            PROFILE_END(cleanStart, cleanup);
 
-            task::sleep(50); //Sleep if nothing to do.
+            task::sleep(10); //Sleep if nothing to do, 200 samples at 20kHz.
+#endif
         }
     }
 };
@@ -16,6 +16,11 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#ifndef OSCILLATORS_H_
+#define OSCILLATORS_H_
+
+#include <cstdint>
+
 /* \brief Approximation of sin(2pi*phi).
  *
  * This uses the Bhaskara I's sine approximation formula
@@ -28,7 +33,7 @@
  *
  * \return The approximate value of sin(2*pi*phi).
  */
-inline float sine(float phase){
+inline float sine(float phase, float = 0.f){
     float sign = -1 * (phase > .5) + 1 * (phase < .5);
     phase = phase - .5 * (phase > .5);
     return sign * 32*phase*(1-2*phase)/(5-8*phase*(1-2*phase));
@@ -44,7 +49,7 @@ inline float sine(float phase){
  *
  * \return The value of the triangle wave at position phi.
  */
-inline float triangle(float phase){
+inline float triangle(float phase, float = 0.f){
     //boolean arithmetic is faster than branching
     return (phase <= .5) * (4*phase - 1) + (phase > .5) * (3 - 4*phase);
 }
@@ -59,7 +64,7 @@ inline float triangle(float phase){
  *
  * \return The value of the saw wave at position phi.
  */
-inline float saw(float phase){
+inline float saw(float phase, float = 0.f){
     //boolean arithmetic is faster than branching
     return 2*phase - 1;
 }
@@ -74,7 +79,7 @@ inline float saw(float phase){
  *
  * \return The value of the saw wave at position phi.
  */
-inline float square(float phase){
+inline float square(float phase, float = 0.f){
     //boolean arithmetic is faster than branching
     return -1 * (phase <= .5) + 1 * (phase > .5);
 }
@@ -89,7 +94,7 @@ inline float square(float phase){
  *
  * \return The value of the saw wave at position phi.
  */
-inline float square25pwm(float phase){
+inline float square25pwm(float phase, float = 0.f){
     //boolean arithmetic is faster than branching
     return -1 * (phase <= .75) + 1 * (phase > .75);
 }
@@ -104,8 +109,79 @@ inline float square25pwm(float phase){
  *
  * \return The value of the saw wave at position phi.
  */
-inline float square10pwm(float phase){
+inline float square10pwm(float phase, float = 0.f){
     //boolean arithmetic is faster than branching
     return -1 * (phase <= .9) + 1 * (phase > .9);
 }
 
+/* \brief Polynomial band limited step (PolyBLEP) residual.
+ *
+ * Two sample polynomial approximation of the difference between a band limited
+ * and a naive step of height 2 at phase 0. Subtracting it from a waveform which
+ * falls by 2 at phase 0 removes most of the aliasing of the step.
+ * Only the samples within dt around the step are changed.
+ *
+ * \param[in] t The phase relative to the step. Must be in [0, 1].
+ * \param[in] dt The phase increment per sample. Should be below 0.5, 0 disables the correction.
+ *
+ * \return The correction, in [-1, 1].
+ */
+inline float polyblep(float t, float dt){
+    if(t < dt){
+        t = t / dt;
+        return t + t - t*t - 1.f;
+    }else if(t > 1.f - dt){
+        t = (t - 1.f) / dt;
+        return t*t + t + t + 1.f;
+    }
+    return 0.f;
+}
+
+/* \brief Computes a band limited saw wave.
+ *
+ * Same shape as saw() with the step at phase 0 corrected by polyblep().
+ * In a modulated operator dt is the unmodulated increment, so the correction
+ * is only approximate.
+ *
+ * \param[in] phase The phase of the saw wave. Must be in [0, 1].
+ * \param[in] dt The phase increment per sample.
+ *
+ * \return The value of the saw wave at position phi.
+ */
+inline float saw_blep(float phase, float dt){
+    return 2*phase - 1 - polyblep(phase, dt);
+}
+
+/* \brief Computes a band limited pulse wave.
+ *
+ * -1 below width and 1 from width on, both steps are corrected by polyblep().
+ *
+ * \param[in] phase The phase of the pulse wave. Must be in [0, 1].
+ * \param[in] dt The phase increment per sample.
+ * \param[in] width The phase of the rising step. Must be in (0, 1).
+ *
+ * \return The value of the pulse wave at position phi.
+ */
+inline float pulse_blep(float phase, float dt, float width){
+    float rise = phase - width + 1.f;
+    rise -= (int32_t)rise;
+    //The naive part has to take the value after the step at the step itself
+    return -1 * (phase < width) + 1 * (phase >= width) + polyblep(rise, dt) - polyblep(phase, dt);
+}
+
+/* \brief Computes a band limited square wave. Same shape as square(). */
+inline float square_blep(float phase, float dt){
+    return pulse_blep(phase, dt, .5f);
+}
+
+/* \brief Computes a band limited square wave with 25% duty cycle. Same shape as square25pwm(). */
+inline float square25pwm_blep(float phase, float dt){
+    return pulse_blep(phase, dt, .75f);
+}
+
+/* \brief Computes a band limited square wave with 10% duty cycle. Same shape as square10pwm(). */
+inline float square10pwm_blep(float phase, float dt){
+    return pulse_blep(phase, dt, .9f);
+}
+
+#endif /* OSCILLATORS_H_ */
@@ -0,0 +1,109 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef OSCILLATORS_Q15_H_
+#define OSCILLATORS_Q15_H_
+
+/*\file oscillators_q15.h
+ * \brief Fixed point versions of the oscillators in oscillators.h.
+ *
+ * The phase is a 32 bit accumulator where 2^32 equals one cycle,
+ * so it wraps around for free. The output is in Q15.
+ */
+
+#include "fixed_point.h"
+#include "OSCParam.h"
+
+typedef q15_t(*osc_fn_q15)(uint32_t);
+
+/* \brief Approximation of sin(2pi*phi) in Q15.
+ *
+ * Uses the parabola 4x(1-|x|) with x in [-1, 1) and one refinement step
+ * y = 0.225(y|y| - y) + y. No division is needed.
+ * The maximum error is about 1e-3.
+ *
+ * \param[in] phase The phase, 2^32 equals one cycle.
+ *
+ * \return The approximate value of sin(2*pi*phi).
+ */
+inline q15_t sine_q15(uint32_t phase){
+    //Upper half of the phase interpreted as signed is x in [-1, 1) for sin(pi*x)
+    const int32_t x = (int16_t)(phase >> 16);
+    const int32_t absx = x < 0 ? -x : x;
+    int32_t y = (x * (32768 - absx)) >> 13;
+    y = ssat16(y);
+    const int32_t absy = y < 0 ? -y : y;
+    y += (7373 * (((y * absy) >> 15) - y)) >> 15; //0.225 in Q15
+    return ssat16(y);
+}
+
+/* \brief Computes a triangle wave in Q15.
+ *
+ * Same shape as triangle().
+ */
+inline q15_t triangle_q15(uint32_t phase){
+    const int32_t x = phase >> 16;
+    return ssat16(x <= 32768 ? 2*x - 32768 : 98304 - 2*x);
+}
+
+/* \brief Computes a saw wave in Q15.
+ *
+ * Same shape as saw().
+ */
+inline q15_t saw_q15(uint32_t phase){
+    return (q15_t)((phase >> 16) - 32768);
+}
+
+/* \brief Computes a square wave in Q15.
+ *
+ * Same shape as square().
+ */
+inline q15_t square_q15(uint32_t phase){
+    return phase <= 0x80000000U ? -32767 : 32767;
+}
+
+/* \brief Computes a square wave with 25% duty cycle in Q15.
+ *
+ * Same shape as square25pwm().
+ */
+inline q15_t square25pwm_q15(uint32_t phase){
+    return phase <= 0xC0000000U ? -32767 : 32767;
+}
+
+/* \brief Computes a square wave with 10% duty cycle in Q15.
+ *
+ * Same shape as square10pwm().
+ */
+inline q15_t square10pwm_q15(uint32_t phase){
+    return phase <= 0xE6666666U ? -32767 : 32767;
+}
+
+inline q15_t empty_q15(uint32_t){
+    return 0;
+}
+
+/**
+ * \brief Finds the fixed point version of a floating point oscillator.
+ *
+ * \param[in] fn The floating point oscillator.
+ *
+ * \return The matching fixed point oscillator or nullptr if there is none.
+ */
+osc_fn_q15 findOscillatorQ15(OSCParam::osc_fn fn);
+
+#endif /* OSCILLATORS_Q15_H_ */
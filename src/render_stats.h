@@ -0,0 +1,105 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RENDER_STATS_H_
+#define RENDER_STATS_H_
+
+/*\file render_stats.h
+ * \brief Cycle budget instrumentation of the render loop.
+ *
+ * If FM432_PROFILE is set, the render loop records how many cycles
+ * (ns on the host) it spends per rendered sample, in cleanVoicePool()
+ * and in the MIDI handling, and how many samples the MIDI events were
+ * applied too late. At 48MHz and 20kHz the budget is 2400 cycles
+ * per sample for everything.
+ *
+ * If FM432_PROFILE is not set the macros expand to nothing.
+ */
+
+#ifndef FM432_PROFILE
+#define FM432_PROFILE 0
+#endif
+
+#if FM432_PROFILE
+
+#include "cycle_counter.h"
+#include <cstdint>
+
+/**
+ * \brief Statistics of one kind of measurement.
+ */
+struct ProfileCounter{
+    uint64_t total = 0; /**< Sum of all measured durations. */
+    uint32_t count = 0; /**< Number of measurements, or samples for the render counter. */
+    uint32_t worst = 0; /**< Longest single measurement, per sample for the render counter. */
+
+    inline void add(uint32_t duration, uint32_t n=1){
+        total += duration;
+        count += n;
+        const uint32_t perItem = duration / n;
+        worst = perItem > worst ? perItem : worst;
+    }
+
+    /**
+     * \brief Average duration per measurement (or per sample).
+     */
+    inline uint32_t average() const {return count ? total / count : 0;}
+};
+
+/**
+ * \brief Render loop statistics.
+ *
+ * \note The MIDI counter is written from the UART interrupt. Reading the
+ *       struct from the render task can observe a half updated counter.
+ */
+struct RenderStats{
+    ProfileCounter render; /**< Render and output time per sample. Worst is the worst block, per sample. */
+    ProfileCounter cleanup; /**< Time per cleanVoicePool() call. */
+    ProfileCounter midi; /**< Time per received MIDI byte, parsing and queueing the event. */
+    ProfileCounter midiLate; /**< Samples a MIDI event was applied after its time stamp, 0 if sample accurate. */
+
+    inline void reset(){
+        render = ProfileCounter();
+        cleanup = ProfileCounter();
+        midi = ProfileCounter();
+        midiLate = ProfileCounter();
+    }
+};
+
+inline RenderStats renderStats; /**< The statistics of the render loop. */
+
+/**
+ * \brief Returns a copy of the current statistics.
+ */
+inline RenderStats getRenderStats(){
+    return renderStats;
+}
+
+#define PROFILE_START(name) const timestamp_t name = readTimestamp()
+#define PROFILE_END(name, counter) renderStats.counter.add(readTimestamp() - name)
+#define PROFILE_END_N(name, counter, n) renderStats.counter.add(readTimestamp() - name, n)
+
+#else
+
+#define PROFILE_START(name)
+#define PROFILE_END(name, counter)
+#define PROFILE_END_N(name, counter, n)
+
+#endif
+
+#endif /* RENDER_STATS_H_ */
@@ -0,0 +1,124 @@
+/*
+ *  FM 432: A FM-Synthesizer implemented on the MSP432
+ *  Copyright (C) 2022  Paul Häger
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef WAVETABLES_H_
+#define WAVETABLES_H_
+
+/*\file wavetables.h
+ * \brief Table lookup oscillators with linear interpolation.
+ *
+ * The tables are generated at compile time and are constant, so they end up
+ * in .rodata which is placed in the flash by the linker script.
+ * A lookup costs a multiplication, two loads and a linear interpolation
+ * instead of the division of sine().
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * \brief Table size used by sine_wt().
+ *
+ * Supported sizes are 256, 1024 and 4096. Each entry takes 4 bytes of flash.
+ */
+#ifndef WAVETABLE_SIZE
+#define WAVETABLE_SIZE 1024
+#endif
+
+/**
+ * \brief Compile time evaluation of sin(x).
+ *
+ * Reduces x into [-pi, pi] and evaluates the taylor series.
+ * Only meant for generating tables, use sine() or a table at run time.
+ */
+constexpr double constexprSin(double x){
+    constexpr double pi = 3.14159265358979323846;
+    while(x > pi){
+        x -= 2*pi;
+    }
+    while(x < -pi){
+        x += 2*pi;
+    }
+    double term = x;
+    double sum = x;
+    for(int i = 1; i < 20; ++i){
+        term *= -x * x / ((2*i) * (2*i + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+/**
+ * \brief One cycle of a sine with N entries.
+ *
+ * The table holds one extra entry equal to the first one, so the
+ * interpolation never needs to wrap the index.
+ */
+template<size_t N>
+struct SineTable{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "Table size must be a power of two.");
+
+    float values[N + 1];
+
+    constexpr SineTable() : values() {
+        for(size_t i = 0; i < N; ++i){
+            values[i] = static_cast<float>(constexprSin(2 * 3.14159265358979323846 * i / N));
+        }
+        values[N] = values[0];
+    }
+};
+
+template<size_t N>
+inline constexpr SineTable<N> sineTable{};
+
+/* \brief Interpolated table lookup of sin(2pi*phi).
+ *
+ * \param[in] phase Argument of sin. Must be in [0, 1].
+ *
+ * \return The interpolated value of sin(2*pi*phi).
+ */
+template<size_t N>
+inline float sineWavetable(float phase){
+    const float pos = phase * N;
+    const uint32_t idx = static_cast<uint32_t>(pos);
+    const float frac = pos - idx;
+    const float* values = sineTable<N>.values + (idx & (N - 1));
+    return values[0] + frac * (values[1] - values[0]);
+}
+
+/* \brief Sine oscillator with a 256 entry table. Max error about 7.5e-5. */
+inline float sine256(float phase, float = 0.f){
+    return sineWavetable<256>(phase);
+}
+
+/* \brief Sine oscillator with a 1024 entry table. Max error about 4.8e-6. */
+inline float sine1024(float phase, float = 0.f){
+    return sineWavetable<1024>(phase);
+}
+
+/* \brief Sine oscillator with a 4096 entry table. Max error about 3.5e-7. */
+inline float sine4096(float phase, float = 0.f){
+    return sineWavetable<4096>(phase);
+}
+
+/* \brief Sine oscillator with a WAVETABLE_SIZE entry table. */
+inline float sine_wt(float phase, float = 0.f){
+    return sineWavetable<WAVETABLE_SIZE>(phase);
+}
+
+#endif /* WAVETABLES_H_ */